@@ -1,7 +1,88 @@
 #include "Base.h"
+#include <dirent.h>
+#include <sys/time.h>
 
 const int lines_score[6] = { 10, 60, 160, 310, 510, 760 };
 
+Hash zobrist[FIELD_HEIGHT][FIELD_WIDTH];
+
+/* Hash of each possible low and high byte of each row, combining the
+   zobrist keys of the tiles set in them. */
+static Hash row_key[FIELD_HEIGHT][2][256];
+
+/* Fills the zobrist table with fixed pseudo-random keys (xorshift64*), so
+   hashes are the same in every run. */
+static void init_zobrist(void)
+{
+    Hash state = 0x9E3779B97F4A7C15ull;
+    int x, y, n;
+
+    for(y = 0; y < FIELD_HEIGHT; ++y)
+    {
+        for(x = 0; x < FIELD_WIDTH; ++x)
+        {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            zobrist[y][x] = state*0x2545F4914F6CDD1Dull;
+        }
+        for(n = 0; n < 256; ++n)
+            for(x = 0; x < 8; ++x)
+                if(n >> x & 1)
+                {
+                    row_key[y][0][n] ^= zobrist[y][x];
+                    if(8 + x < FIELD_WIDTH)
+                        row_key[y][1][n] ^= zobrist[y][8 + x];
+                }
+    }
+}
+
+#define row_hash(y, row) (row_key[y][0][(row) & 255] ^ row_key[y][1][(row) >> 8])
+
+/* Hash of the tiles of row 'y' set in id plane 'k': the row hash, rotated
+   so that the planes do not cancel each other. */
+#define id_hash(k, y, row) \
+    (row_hash(y, row) << (16*(k) + 8) | row_hash(y, row) >> (56 - 16*(k)))
+
+Hash field_hash(const Field *field)
+{
+    Hash hash = 0;
+    int y, k;
+    for(y = 0; y < FIELD_HEIGHT; ++y)
+    {
+        hash ^= row_hash(y, field->row[y]);
+        for(k = 0; k < ID_BITS; ++k)
+            hash ^= id_hash(k, y, field->id[k][y]);
+    }
+    return hash;
+}
+
+/* Returns the piece id of the tile at column 'x' of row 'y', or 0 if it is
+   free. */
+int tile_id(const Field *field, int x, int y)
+{
+    int k, id = 0;
+    for(k = 0; k < ID_BITS; ++k)
+        id |= (field->id[k][y] >> x & 1) << k;
+    return id;
+}
+
+long long utime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1000000ll*tv.tv_sec + tv.tv_usec;
+}
+
+/* Returns the next number of an xorshift64* generator. */
+Random next_random(Random *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
 void print_form(FILE *fp, const Form *form)
 {
     int x, y;
@@ -19,7 +100,7 @@ void print_field(FILE *fp, const Field *field)
     for(y = FIELD_HEIGHT - 1; y >= 0; --y)
     {
         for(x = 0; x < FIELD_WIDTH; ++x)
-            fputc(field->tile[x][y] ? '#' : '.', fp);
+            fputc((field->row[y] >> x) & 1 ? '#' : '.', fp);
     }
     for(x = 0; x < FIELD_WIDTH; ++x)
         fprintf(fp, "%d%c", field->top[x], (x == FIELD_WIDTH - 1) ? '\n' : ' ');
@@ -42,7 +123,14 @@ void print_stats(FILE *fp, const Stats *stats)
         stats->pos, stats->instr, stats->discarded, stats->dropped,
         stats->cleared[0], stats->cleared[1], stats->cleared[2],
         stats->cleared[3], stats->cleared[4], stats->cleared[5],
-        stats->score + 400*(5 - stats->discarded) );
+        final_score(stats) );
+}
+
+/* Returns the score reported by print_stats(), which includes the bonus
+   for discards left unused. */
+int final_score(const Stats *stats)
+{
+    return stats->score + DISCARD_BONUS*(MAX_DISCARDS - stats->discarded);
 }
 
 
@@ -170,6 +258,13 @@ bool load_piece(Piece *piece, char id, const char *filepath)
             }
         }
 
+    /* Compute row masks */
+    for(rot = 0; rot < 4; ++rot)
+        for(y = 0; y < base[rot].height; ++y)
+            for(x = 0; x < base[rot].width; ++x)
+                if(base[rot].tile[x][y])
+                    base[rot].mask[y] |= 1 << x;
+
     /* Assign results */
     for(rot = 0; rot < 4; ++rot)
         piece->form[rot] = base[rot];
@@ -179,61 +274,348 @@ bool load_piece(Piece *piece, char id, const char *filepath)
     return true;
 }
 
-int place(Field *field, const Form *form, int xpos)
+static int landing_height(const Field *field, const Placement *p)
 {
-    int n, m, x, y, cleared = 0, ypos = 0;
+    const char *top = field->top + p->xpos;
+    int n, y, ypos = 0;
 
-    /* Determine y-position of block */
-    for(n = 0; n < form->width; ++n)
+    for(n = 0; n < p->width; ++n)
     {
-        if(form->bottom[n] >= 0)
+        y = top[n] - p->bottom[n];
+        ypos = (y > ypos) ? y : ypos;
+    }
+    return ypos;
+}
+
+int drop_height(const Field *field, const Form *form, int xpos)
+{
+    return landing_height(field, &form->at[xpos]);
+}
+
+/* Marks the tiles of row 'y' whose piece id differs from that of the tile
+   'shift' columns to their right in row 'below' (only meaningful where
+   both tiles are occupied). */
+static Row id_differences(const Field *field, int y, int below, int shift)
+{
+    Row diff = 0;
+    int k;
+    for(k = 0; k < ID_BITS; ++k)
+        diff |= field->id[k][y] ^ field->id[k][below] >> shift;
+    return diff;
+}
+
+/* Counts the boundaries within rows 'lo' through 'hi' (in excess of those
+   of empty rows) and between rows 'lo' through 'hi' + 1 and the rows below
+   them. Nothing else changes when these rows are modified. */
+static int band_boundaries(const Field *field, int lo, int hi)
+{
+    const Row *row = field->row;
+    int y, n = 0;
+
+    for(y = lo; y <= hi; ++y)
+    {
+        unsigned walled = row[y] << 1 | 1 | 1 << (FIELD_WIDTH + 1);
+        n += count_bits((walled ^ walled >> 1) & (2*FULL_ROW + 1)) - 2;
+        n += count_bits(id_differences(field, y, y, 1) & row[y] & row[y] >> 1);
+    }
+    for(y = lo; y <= hi + 1 && y < FIELD_HEIGHT; ++y)
+    {
+        n += count_bits(row[y] ^ (y > 0 ? row[y - 1] : FULL_ROW));
+        if(y > 0)
+            n += count_bits( id_differences(field, y, y - 1, 0) &
+                             row[y] & row[y - 1] );
+    }
+    return n;
+}
+
+/* Places a form as described for place(), and if 'undo' is not NULL,
+   records what is needed to take the placement back. */
+static int place_at(Field *field, const Placement *p, Undo *undo)
+{
+    int n, k, x, y, cleared = 0, ypos = landing_height(field, p),
+        hi = ypos + p->height - 1;
+
+    if(hi >= FIELD_HEIGHT)
+        return -1;
+
+    if(undo)
+    {
+        undo->placement  = p;
+        undo->hash       = field->hash;
+        undo->boundaries = field->boundaries;
+        undo->heights    = field->heights;
+        undo->ypos       = ypos;
+        memcpy(undo->top, field->top, sizeof(undo->top));
+    }
+
+    field->boundaries -= band_boundaries(field, ypos, hi);
+    for(n = 0; n < p->height; ++n)
+    {
+        field->row[ypos + n] |= p->mask[n];
+        field->hash ^= row_hash(ypos + n, p->mask[n]);
+        for(k = 0; k < ID_BITS; ++k)
+            if(p->id >> k & 1)
+            {
+                field->id[k][ypos + n] |= p->mask[n];
+                field->hash ^= id_hash(k, ypos + n, p->mask[n]);
+            }
+    }
+    for(n = 0; n < p->width; ++n)
+    {
+        x = p->xpos + n;
+        y = ypos + p->top[n];
+        y = (y > field->top[x]) ? y : field->top[x];
+        field->heights += y*y - field->top[x]*field->top[x];
+        field->top[x] = y;
+    }
+
+    for(y = hi; y >= ypos; --y)
+    {
+        if(field->row[y] != FULL_ROW)
+            continue;
+        if(undo)
+        {
+            undo->row[cleared] = y;
+            for(k = 0; k < ID_BITS; ++k)
+                undo->id[cleared][k] = field->id[k][y];
+        }
+        ++cleared;
+        memmove( &field->row[y], &field->row[y + 1],
+                 (FIELD_HEIGHT - 1 - y)*sizeof(Row) );
+        field->row[FIELD_HEIGHT - 1] = 0;
+        for(k = 0; k < ID_BITS; ++k)
+        {
+            memmove( &field->id[k][y], &field->id[k][y + 1],
+                     (FIELD_HEIGHT - 1 - y)*sizeof(Row) );
+            field->id[k][FIELD_HEIGHT - 1] = 0;
+        }
+    }
+
+    /* Rows above the cleared ones moved down unchanged, and the free rows
+       added at the top only border the row below them. */
+    field->boundaries += band_boundaries(field, ypos, hi - cleared);
+    if(cleared && hi + 1 < FIELD_HEIGHT)
+        field->boundaries += count_bits(field->row[FIELD_HEIGHT - 1 - cleared]);
+
+    if(cleared)
+    {
+        field->heights = 0;
+        for(x = 0; x < FIELD_WIDTH; ++x)
         {
-            m = field->top[xpos + n] - form->bottom[n];
-            if(m > ypos)
-                ypos = m;
+            field->top[x] -= cleared;
+            while(field->top[x] && !(field->row[field->top[x] - 1] >> x & 1))
+                --field->top[x];
+            field->heights += field->top[x]*field->top[x];
         }
+        field->hash = field_hash(field);
     }
 
+    if(undo)
+        undo->cleared = cleared;
+    return cleared;
+}
+
+int place(Field *field, const Form *form, int xpos)
+{
+    return place_at(field, &form->at[xpos], NULL);
+}
+
+/* Plain implementation of place(), which recomputes everything it keeps
+   up to date from the rows of the field. place() must produce exactly the
+   same fields. */
+int place_reference(Field *field, const Form *form, int xpos)
+{
+    int n, m, k, x, y, ypos = 0, cleared = 0;
+
+    for(n = 0; n < form->width; ++n)
+        for(m = 0; m < form->height; ++m)
+            if(form->tile[n][m] && field->top[xpos + n] - m > ypos)
+                ypos = field->top[xpos + n] - m;
     if(ypos + form->height > FIELD_HEIGHT)
         return -1;
 
     for(n = 0; n < form->width; ++n)
-    {
         for(m = 0; m < form->height; ++m)
             if(form->tile[n][m])
-                field->tile[xpos + n][ypos + m] = form->tile[n][m];
-        if(form->top[n] >= 0)
-            field->top[xpos + n] = ypos + form->top[n];
+            {
+                field->row[ypos + m] |= 1 << (xpos + n);
+                for(k = 0; k < ID_BITS; ++k)
+                    if(form->tile[n][m] >> k & 1)
+                        field->id[k][ypos + m] |= 1 << (xpos + n);
+            }
+
+    for(y = FIELD_HEIGHT - 1; y >= 0; --y)
+        if(field->row[y] == FULL_ROW)
+        {
+            memmove( &field->row[y], &field->row[y + 1],
+                     (FIELD_HEIGHT - 1 - y)*sizeof(Row) );
+            field->row[FIELD_HEIGHT - 1] = 0;
+            for(k = 0; k < ID_BITS; ++k)
+            {
+                memmove( &field->id[k][y], &field->id[k][y + 1],
+                         (FIELD_HEIGHT - 1 - y)*sizeof(Row) );
+                field->id[k][FIELD_HEIGHT - 1] = 0;
+            }
+            ++cleared;
+        }
+
+    field->heights = 0;
+    for(x = 0; x < FIELD_WIDTH; ++x)
+    {
+        field->top[x] = 0;
+        for(y = 0; y < FIELD_HEIGHT; ++y)
+            if(field->row[y] >> x & 1)
+                field->top[x] = y + 1;
+        field->heights += field->top[x]*field->top[x];
     }
 
+    /* Neighbouring tiles with different piece ids (0 for free tiles) are
+       separated by a boundary, as are the walls and floor from free tiles */
+    field->boundaries = -EMPTY_BOUNDARIES;
+    for(y = 0; y < FIELD_HEIGHT; ++y)
+    {
+        field->boundaries += !tile_id(field, 0, y) +
+                             !tile_id(field, FIELD_WIDTH - 1, y);
+        for(x = 1; x < FIELD_WIDTH; ++x)
+            field->boundaries += tile_id(field, x - 1, y) != tile_id(field, x, y);
+    }
+    for(x = 0; x < FIELD_WIDTH; ++x)
+    {
+        field->boundaries += !tile_id(field, x, 0);
+        for(y = 1; y < FIELD_HEIGHT; ++y)
+            field->boundaries += tile_id(field, x, y - 1) != tile_id(field, x, y);
+    }
+
+    field->hash = field_hash(field);
+    return cleared;
+}
+
+/* Like place(), but records the changes made to the field in 'undo', so
+   that unplace() can restore the field afterwards. */
+int place_reversibly(Field *field, const Form *form, int xpos, Undo *undo)
+{
+    return place_at(field, &form->at[xpos], undo);
+}
+
+/* Takes back a placement made by place_reversibly() (which must not have
+   failed). Placements must be taken back in reverse order. */
+void unplace(Field *field, const Undo *undo)
+{
+    const Placement *p = undo->placement;
+    int n, k, y;
+
+    /* Reinsert cleared rows (which were all full) in reverse order */
+    for(n = undo->cleared - 1; n >= 0; --n)
+    {
+        y = undo->row[n];
+        memmove( &field->row[y + 1], &field->row[y],
+                 (FIELD_HEIGHT - 1 - y)*sizeof(Row) );
+        field->row[y] = FULL_ROW;
+        for(k = 0; k < ID_BITS; ++k)
+        {
+            memmove( &field->id[k][y + 1], &field->id[k][y],
+                     (FIELD_HEIGHT - 1 - y)*sizeof(Row) );
+            field->id[k][y] = undo->id[n][k];
+        }
+    }
+
+    for(n = 0; n < p->height; ++n)
+    {
+        field->row[undo->ypos + n] &= ~p->mask[n];
+        for(k = 0; k < ID_BITS; ++k)
+            field->id[k][undo->ypos + n] &= ~p->mask[n];
+    }
+
+    field->hash       = undo->hash;
+    field->boundaries = undo->boundaries;
+    field->heights    = undo->heights;
+    memcpy(field->top, undo->top, sizeof(field->top));
+}
+
+/* Copies the piece ids of 'form' dropped at height 'ypos' into 'tiles' and
+   removes full rows, mirroring what place() does to the field. */
+static void place_tiles(Tiles *tiles, const Form *form, int xpos, int ypos)
+{
+    int n, m, x, y;
+
+    for(n = 0; n < form->width; ++n)
+        for(m = 0; m < form->height; ++m)
+            if(form->tile[n][m])
+                tiles->tile[xpos + n][ypos + m] = form->tile[n][m];
+
     for(y = ypos + form->height - 1; y >= ypos; --y)
     {
         for(x = 0; x < FIELD_WIDTH; ++x)
-            if(!field->tile[x][y])
+            if(!tiles->tile[x][y])
                 goto noline;
-        ++cleared;
         for(n = 0; n < FIELD_WIDTH; ++n)
         {
-            --field->top[n];
-            for(m = y; m < field->top[n]; ++m)
-                field->tile[n][m] = field->tile[n][m + 1];
-            field->tile[n][(int)field->top[n]] = 0;
-            while(field->top[n] && !field->tile[n][field->top[n] - 1])
-                --field->top[n];
+            for(m = y; m < FIELD_HEIGHT - 1; ++m)
+                tiles->tile[n][m] = tiles->tile[n][m + 1];
+            tiles->tile[n][FIELD_HEIGHT - 1] = 0;
         }
     noline:
         continue;
     }
+}
 
-    return cleared;
+/* Prepares the placements of each form and the list of moves of a piece. */
+static void init_moves(Piece *piece)
+{
+    int rot, x, n;
+
+    piece->moves = 0;
+    for(rot = 0; rot < piece->forms; ++rot)
+    {
+        Form *form = &piece->form[rot];
+        for(x = 0; x + form->width <= FIELD_WIDTH; ++x)
+        {
+            Placement *p = &form->at[x];
+            p->xpos   = x;
+            p->width  = form->width;
+            p->height = form->height;
+            for(n = 0; n < PIECE_SIZE; ++n)
+            {
+                bool empty = n >= form->width || form->bottom[n] < 0;
+                p->bottom[n] = empty ? FIELD_HEIGHT + PIECE_SIZE : form->bottom[n];
+                p->top[n]    = empty ? -FIELD_HEIGHT - PIECE_SIZE : form->top[n];
+                p->mask[n]   = form->mask[n] << x;
+            }
+            p->id = form->id;
+            piece->move[piece->moves].form = rot;
+            piece->move[piece->moves].xpos = x;
+            ++piece->moves;
+        }
+    }
 }
 
-Game *load_game(const char *dir)
+/* Loads the pieces 0.txt through 9.txt of a game directory. */
+static bool load_pieces(Game *game, const char *dir)
+{
+    char path[1024];
+    int n;
+
+    for(n = 0; n < NUM_PIECES; ++n)
+    {
+        sprintf(path, "%s/%d.txt", dir, n);
+        if(!load_piece(&game->piece[n], n + 1, path))
+        {
+            fprintf(stderr, "Unable to load piece %d from file \"%s\"!\n", n, path);
+            return false;
+        }
+        init_moves(&game->piece[n]);
+    }
+    return true;
+}
+
+/* Opens the game data of a game directory, storing its size in '*size'. */
+static FILE *open_game_data(const char *dir, long *size)
 {
     char path[1024];
-    Game *game;
     FILE *fp;
-    long size, n;
+
+    if(!zobrist[0][0])
+        init_zobrist();
 
     if(strlen(dir) > sizeof(path) - 32)
     {
@@ -241,7 +623,6 @@ Game *load_game(const char *dir)
         return NULL;
     }
 
-    /* Read game data */
     sprintf(path, "%s/game.txt", dir);
     fp = fopen(path, "rt");
     if(!fp)
@@ -249,16 +630,38 @@ Game *load_game(const char *dir)
         fprintf(stderr, "Unable to open game data from file \"%s\"!\n", path);
         return NULL;
     }
-    if(fseek(fp, 0, SEEK_END) == -1)
-        return NULL;
-    size = ftell(fp);
-    if(size == -1)
+    if(fseek(fp, 0, SEEK_END) == -1 || (*size = ftell(fp)) == -1)
+    {
+        fclose(fp);
         return NULL;
+    }
     rewind(fp);
+    return fp;
+}
+
+Game *load_game(const char *dir)
+{
+    Game *game;
+    FILE *fp;
+    long size, n;
+
+    /* Read game data */
+    fp = open_game_data(dir, &size);
+    if(!fp)
+        return NULL;
     game = malloc(sizeof(*game) + size - sizeof(game->input));
-    game->input_size = size;
+    if(!game)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    game->input_size   = size;
+    game->input_mask   = -1;
+    game->input_loaded = size;
+    game->stream       = NULL;
     if(fread(game->input, 1, size, fp) != size)
     {
+        fclose(fp);
         free(game);
         return NULL;
     }
@@ -267,6 +670,7 @@ Game *load_game(const char *dir)
         if(game->input[n] < '0' || game->input[n] > '9')
         {
             fprintf(stderr, "Invalid character in game data (%d)\n", (int)game->input[n]);
+            fclose(fp);
             free(game);
             return NULL;
         }
@@ -274,65 +678,238 @@ Game *load_game(const char *dir)
     }
     fclose(fp);
 
-    /* Read pieces */
-    for(n = 0; n < 10; ++n)
+    if(!load_pieces(game, dir))
     {
-        sprintf(path, "%s/%d.txt", dir, (int)n);
-        if(!load_piece(&game->piece[n], n + 1, path))
+        free(game);
+        return NULL;
+    }
+    return game;
+}
+
+/* Reads and validates the pieces of a streamed game up to STREAM_AHEAD
+   pieces beyond 'pos'. Invalid or missing data ends the game early. */
+static void read_ahead(Game *game, int pos)
+{
+    int end = pos + STREAM_AHEAD, start, count, n;
+    char *p;
+
+    if(end > game->input_size)
+        end = game->input_size;
+    while(game->input_loaded < end)
+    {
+        start = game->input_loaded & game->input_mask;
+        count = end - game->input_loaded;
+        if(count > STREAM_WINDOW - start)
+            count = STREAM_WINDOW - start;
+        p = &game->input[start];
+        count = fread(p, 1, count, game->stream);
+        for(n = 0; n < count && p[n] >= '0' && p[n] <= '9'; ++n)
+            p[n] -= '0';
+        game->input_loaded += n;
+        if(n < count || count == 0)
         {
-            fprintf( stderr, "Unable to load piece %d from file \"%s\"!\n",
-                     (int)n, path );
-            free(game);
-            return NULL;
+            if(n < count)
+                fprintf(stderr, "Invalid character in game data (%d)\n", (int)p[n]);
+            else
+                fprintf(stderr, "Unexpected end of game data!\n");
+            game->input_size = game->input_loaded;
+            break;
         }
     }
+}
+
+/* Like load_game(), but reads the game data lazily through a window of
+   fixed size as has_piece() is called for successive positions, so memory
+   use does not depend on the length of the game. */
+Game *stream_game(const char *dir)
+{
+    Game *game;
+    FILE *fp;
+    long size;
 
+    fp = open_game_data(dir, &size);
+    if(!fp)
+        return NULL;
+    game = malloc(sizeof(*game) + STREAM_WINDOW - sizeof(game->input));
+    if(!game)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    game->input_size   = size;
+    game->input_mask   = STREAM_WINDOW - 1;
+    game->input_loaded = 0;
+    game->stream       = fp;
+    if(!load_pieces(game, dir))
+    {
+        fclose(fp);
+        free(game);
+        return NULL;
+    }
+    read_ahead(game, 0);
     return game;
 }
 
-bool update_field(Field *field, const Form *form, int xpos, Stats *stats)
+/* Returns whether a game has a piece at 'pos', first refilling the window
+   of a streamed game if fewer than STREAM_AHEAD/2 pieces are left in it. */
+bool has_piece(Game *game, int pos)
+{
+    if(game->stream && game->input_loaded - pos < STREAM_AHEAD/2)
+        read_ahead(game, pos);
+    return pos < game->input_size;
+}
+
+bool update_field( Field *field, Tiles *tiles, const Form *form, int xpos,
+                   Stats *stats )
 {
-    int lines = place(field, form, xpos);
+    int ypos = drop_height(field, form, xpos),
+        lines = place(field, form, xpos);
     if(lines < 0)
         return false;
+    if(tiles)
+        place_tiles(tiles, form, xpos, ypos);
     stats->score += lines_score[lines];
     ++stats->dropped;
     ++stats->cleared[lines];
     return true;
 }
 
-void print_move(FILE *fp, const Game *game, Move move, Stats *stats)
+/* Plays 'move' for the piece at stats->pos: discards the piece if the
+   form of the move is negative, and drops it otherwise. Returns false if
+   the piece does not fit. */
+bool apply_move( Field *field, Tiles *tiles, const Game *game, Move move,
+                 Stats *stats )
 {
+    const Piece *piece = &game->piece[game_input(game, stats->pos)];
+
     if(move.form < 0)
     {
-        fputs("DISCARD\n", fp);
+        ++stats->discarded;
+        return true;
+    }
+    return update_field(field, tiles, &piece->form[move.form], move.xpos, stats);
+}
+
+void open_output(Output *out, int fd, bool binary)
+{
+    out->fd     = fd;
+    out->binary = binary;
+    out->len    = 0;
+    if(binary)
+    {
+        memcpy(out->buf, MOVES_MAGIC, MAGIC_SIZE);
+        out->len = MAGIC_SIZE;
+    }
+}
+
+/* Writes the buffered data. Returns false if it could not be written. */
+bool flush_output(Output *out)
+{
+    size_t done = 0;
+    ssize_t n;
+    bool ok;
+
+    while(done < out->len)
+    {
+        n = write(out->fd, out->buf + done, out->len - done);
+        if(n <= 0)
+            break;
+        done += n;
+    }
+    ok = done == out->len;
+    out->len = 0;
+    return ok;
+}
+
+static void put(Output *out, const char *s, size_t len)
+{
+    memcpy(out->buf + out->len, s, len);
+    out->len += len;
+}
+
+/* Writes the move for the piece at stats->pos, counting the instructions
+   (or records) written in 'stats'. */
+void write_move(Output *out, const Game *game, Move move, Stats *stats)
+{
+    if(out->len > OUTPUT_SIZE - MAX_MOVE_TEXT)
+        flush_output(out);
+
+    if(out->binary)
+    {
+        out->buf[out->len++] = move.form < 0 ? (char)DISCARD_RECORD :
+                                               (char)(move.form << 4 | move.xpos);
         ++stats->instr;
     }
     else
+    if(move.form < 0)
+    {
+        put(out, "NEW BLOCK\nDISCARD\n", 18);
+        stats->instr += 2;
+    }
+    else
     {
-        const Form *form = &game->piece[(int)game->input[stats->pos]].form[move.form];
+        const Form *form = &game->piece[game_input(game, stats->pos)].form[move.form];
 
-        fputs("NEW BLOCK\n", fp);
+        put(out, "NEW BLOCK\n", 10);
         ++stats->instr;
         while(move.form > 0)
         {
-            fputs("ROTATE CCW\n", fp);
+            put(out, "ROTATE CCW\n", 11);
             ++stats->instr;
             --move.form;
         }
         while(move.xpos + form->translation < 0)
         {
-            fputs("MOVE LEFT\n", fp);
+            put(out, "MOVE LEFT\n", 10);
             ++stats->instr;
             ++move.xpos;
         }
         while(move.xpos + form->translation > 0)
         {
-            fputs("MOVE RIGHT\n", fp);
+            put(out, "MOVE RIGHT\n", 11);
             ++stats->instr;
             --move.xpos;
         }
-        fputs("DROP\n", fp);
+        put(out, "DROP\n", 5);
         ++stats->instr;
     }
 }
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+/* Stores the names of up to 'max_games' game directories (those containing
+   a game.txt) in 'corpus' in 'name', sorted. Returns their number, or -1 if
+   the corpus cannot be read. */
+int find_games(const char *corpus, char (*name)[MAX_GAME_NAME], int max_games)
+{
+    char path[1024];
+    struct dirent *entry;
+    DIR *dp;
+    int games = 0;
+
+    if(strlen(corpus) > sizeof(path) - MAX_GAME_NAME - 32)
+    {
+        fprintf(stderr, "Directory path too long!\n");
+        return -1;
+    }
+    dp = opendir(corpus);
+    if(!dp)
+    {
+        fprintf(stderr, "Unable to open directory \"%s\"!\n", corpus);
+        return -1;
+    }
+    while((entry = readdir(dp)) != NULL && games < max_games)
+    {
+        if(entry->d_name[0] == '.' || strlen(entry->d_name) >= MAX_GAME_NAME)
+            continue;
+        sprintf(path, "%s/%s/game.txt", corpus, entry->d_name);
+        if(access(path, R_OK) == 0)
+            strcpy(name[games++], entry->d_name);
+    }
+    closedir(dp);
+    qsort(name, games, sizeof(*name), compare_names);
+    return games;
+}
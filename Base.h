@@ -11,56 +11,168 @@
 #define NUM_PIECES      10
 #define FIELD_WIDTH     15
 #define FIELD_HEIGHT    40
+#define MAX_GAME_NAME  256
+
+/* A row of the field, with bit x set iff column x is occupied. */
+typedef unsigned short Row;
+
+/* Zobrist hash of the occupied tiles of a field and their piece ids. */
+typedef unsigned long long Hash;
+
+/* State of an xorshift64* pseudo-random number generator (never zero). */
+typedef unsigned long long Random;
+
+#define FULL_ROW        ((Row)((1 << FIELD_WIDTH) - 1))
+
+/* Number of boundaries between occupied and free tiles in an empty field,
+   counting the walls and floor as occupied. */
+#define EMPTY_BOUNDARIES    (2*FIELD_HEIGHT + FIELD_WIDTH)
+#define count_bits(x)   __builtin_popcount(x)
+
+/* Number of bit planes needed for the piece ids 1 through NUM_PIECES. */
+#define ID_BITS          4
+
+typedef struct Move
+{
+    int form, xpos;
+} Move;
+
+/* A form at a fixed horizontal position, with its profile and row masks
+   prepared for place(). Columns without tiles have a bottom so high and a
+   top so low that they never affect the landing height or column tops. */
+typedef struct Placement
+{
+    int xpos, width, height;
+    signed char bottom[PIECE_SIZE], top[PIECE_SIZE];
+    Row mask[PIECE_SIZE];
+    char id;
+} Placement;
 
 typedef struct Form
 {
     int width, height;
     char tile[PIECE_SIZE][PIECE_SIZE];
     int bottom[PIECE_SIZE], top[PIECE_SIZE];
+    Row mask[PIECE_SIZE];
     int rotation, translation;
     char id;
+    Placement at[FIELD_WIDTH];  /* for xpos = 0 .. FIELD_WIDTH - width */
 } Form;
 
 typedef struct Piece
 {
     int forms;
     Form form[4];
+    int moves;
+    Move move[4*FIELD_WIDTH];   /* all distinct placements, in search order */
 } Piece;
 
 typedef struct Field
 {
-    char tile[FIELD_WIDTH][FIELD_HEIGHT];
-    int top[FIELD_WIDTH];
+    Hash hash;
+    Row row[FIELD_HEIGHT];
+    Row id[ID_BITS][FIELD_HEIGHT];  /* bit planes of the tiles' piece ids */
+    short boundaries;           /* in excess of EMPTY_BOUNDARIES, counting
+                                   tiles of different pieces as well */
+    short heights;              /* sum of squared column heights */
+    char top[FIELD_WIDTH];
 } Field;
 
+/* Piece ids of the tiles in a field; only kept where they are displayed. */
+typedef struct Tiles
+{
+    char tile[FIELD_WIDTH][FIELD_HEIGHT];
+} Tiles;
+
+/* Changes made by place_reversibly(), to be taken back by unplace(). */
+typedef struct Undo
+{
+    const Placement *placement;
+    Hash hash;
+    short boundaries, heights;
+    char top[FIELD_WIDTH];
+    char ypos, cleared;
+    char row[PIECE_SIZE];       /* full rows removed, in order of removal */
+    Row id[PIECE_SIZE][ID_BITS];    /* and their piece id planes */
+} Undo;
+
+/* The pieces of a game and its sequence of piece ids. A streamed game
+   only holds a window of STREAM_WINDOW ids, which has_piece() refills to
+   at least STREAM_AHEAD/2 pieces beyond the current one. */
 typedef struct Game
 {
     Piece piece[NUM_PIECES];
 
     int input_size;
+    int input_mask;             /* positions wrap around the window */
+    int input_loaded;           /* ids read and validated so far */
+    FILE *stream;               /* game data if streamed, otherwise NULL */
     char input[32];
 } Game;
 
-typedef struct Move
-{
-    int form, xpos;
-} Move;
+#define STREAM_WINDOW   (1 << 16)
+#define STREAM_AHEAD    (STREAM_WINDOW/2)
+
+/* The id of the piece at position 'pos' of a game. */
+#define game_input(game, pos)   ((int)(game)->input[(pos) & (game)->input_mask])
+
+#define MAX_DISCARDS     5
+#define DISCARD_BONUS  400      /* final score for each discard left */
 
 typedef struct Stats
 {
     int pos, instr, score, discarded, dropped, cleared[6];
 } Stats;
 
-const int lines_score[6];
+#define OUTPUT_SIZE     (1 << 16)
+#define MAX_MOVE_TEXT   256         /* longest instruction text of a move */
+
+/* Binary move files start with MOVES_MAGIC, followed by one byte per piece:
+   DISCARD_RECORD, or the rotation in the high and xpos in the low nibble. */
+#define MOVES_MAGIC     "\177MV1"
+#define MAGIC_SIZE      4
+#define DISCARD_RECORD  0xFF
+
+/* A buffered writer of moves, in the instruction text format or as binary
+   records. Data is only written when the buffer fills up or on
+   flush_output(). */
+typedef struct Output
+{
+    int     fd;
+    bool    binary;
+    size_t  len;
+    char    buf[OUTPUT_SIZE];
+} Output;
+
+extern const int lines_score[6];
+extern Hash zobrist[FIELD_HEIGHT][FIELD_WIDTH];
+
+long long utime(void);
+Random next_random(Random *state);
 
 void print_form(FILE *fp, const Form *form);
 void print_field(FILE *fp, const Field *field);
 void print_stats(FILE *fp, const Stats *stats);
-void print_move(FILE *fp, const Game *game, Move move, Stats *stats);
+int final_score(const Stats *stats);
+void open_output(Output *out, int fd, bool binary);
+bool flush_output(Output *out);
+void write_move(Output *out, const Game *game, Move move, Stats *stats);
 
 Game *load_game(const char *dir);
+Game *stream_game(const char *dir);
+bool has_piece(Game *game, int pos);
+int find_games(const char *corpus, char (*name)[MAX_GAME_NAME], int max_games);
 bool load_piece(Piece *piece, char id, const char *filepath);
+Hash field_hash(const Field *field);
+int tile_id(const Field *field, int x, int y);
+int drop_height(const Field *field, const Form *form, int xpos);
 int place(Field *field, const Form *form, int xpos);
-bool update_field(Field *field, const Form *form, int xpos, Stats *stats);
+int place_reference(Field *field, const Form *form, int xpos);
+int place_reversibly(Field *field, const Form *form, int xpos, Undo *undo);
+void unplace(Field *field, const Undo *undo);
+bool update_field( Field *field, Tiles *tiles, const Form *form, int xpos,
+                   Stats *stats );
+bool apply_move( Field *field, Tiles *tiles, const Game *game, Move move,
+                 Stats *stats );
 
 #endif /* ndef BASE_H */
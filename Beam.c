@@ -0,0 +1,247 @@
+#include "Beam.h"
+#include "Eval.h"
+
+/* A state in the beam: the field after placing a piece, the line score
+   accumulated since the root, and the index of its parent in the previous
+   ply together with the move leading from the parent to this state. */
+typedef struct State
+{
+    Field   field;
+    int     score, value, parent;
+    Move    move;
+} State;
+
+typedef struct Candidate
+{
+    int     value, order, parent;
+    Move    move;
+    Hash    hash;
+} Candidate;
+
+struct Beam
+{
+    const Game  *game;
+    int         width, horizon;
+
+    /* The states are kept in an arena of horizon + 1 plies of 'width'
+       states each, used as a ring buffer: ply 0 holds the (single) root
+       state, the last ply holds the states furthest ahead. */
+    State       *state;
+    int         *count;
+    int         first, plies;
+    int         pos;            /* game position of the piece after the root */
+
+    Candidate   *cand;
+    int         *map[2];
+    Hash        *seen;
+    int         seen_mask;
+};
+
+static State *ply_state(Beam *beam, int ply)
+{
+    return beam->state + (beam->first + ply)%(beam->horizon + 1)*beam->width;
+}
+
+static int *ply_count(Beam *beam, int ply)
+{
+    return &beam->count[(beam->first + ply)%(beam->horizon + 1)];
+}
+
+Beam *beam_create(const Game *game, int width, int horizon)
+{
+    Beam *beam = calloc(1, sizeof(*beam));
+
+    if(!beam)
+        return NULL;
+    beam->game      = game;
+    beam->width     = width;
+    beam->horizon   = horizon;
+    beam->state     = calloc((horizon + 1)*width, sizeof(*beam->state));
+    beam->count     = calloc(horizon + 1, sizeof(*beam->count));
+    beam->cand      = malloc(width*4*FIELD_WIDTH*sizeof(*beam->cand));
+    beam->map[0]    = malloc(width*sizeof(*beam->map[0]));
+    beam->map[1]    = malloc(width*sizeof(*beam->map[1]));
+    for(beam->seen_mask = 1; beam->seen_mask < 4*width; beam->seen_mask *= 2) { }
+    beam->seen      = malloc(beam->seen_mask*sizeof(*beam->seen));
+    --beam->seen_mask;
+    if( !beam->state || !beam->count || !beam->cand ||
+        !beam->map[0] || !beam->map[1] || !beam->seen )
+    {
+        beam_destroy(beam);
+        return NULL;
+    }
+
+    /* Start with the empty field as the root */
+    beam->plies    = 1;
+    beam->count[0] = 1;
+    beam->state[0].parent = -1;
+    return beam;
+}
+
+void beam_destroy(Beam *beam)
+{
+    free(beam->state);
+    free(beam->count);
+    free(beam->cand);
+    free(beam->map[0]);
+    free(beam->map[1]);
+    free(beam->seen);
+    free(beam);
+}
+
+/* Orders candidates by decreasing value; ties go to the candidate
+   generated first, as in search(). */
+static int compare_candidates(const void *a, const void *b)
+{
+    const Candidate *c = a, *d = b;
+    if(c->value != d->value)
+        return c->value > d->value ? -1 : 1;
+    return c->order - d->order;
+}
+
+/* Marks a field hash as seen in the current ply. Returns false if it was
+   seen before, i.e. the field is a duplicate of a better state. */
+static bool mark_seen(Beam *beam, Hash hash)
+{
+    int n = (int)(hash & beam->seen_mask);
+
+    if(!hash)
+        hash = 1;
+    while(beam->seen[n])
+    {
+        if(beam->seen[n] == hash)
+            return false;
+        n = (n + 1) & beam->seen_mask;
+    }
+    beam->seen[n] = hash;
+    return true;
+}
+
+/* Adds a ply to the beam, holding the best distinct children of the states
+   in the last ply. Returns false if the horizon or the end of the game was
+   reached, or none of the states in the last ply has a valid move. */
+static bool expand(Beam *beam)
+{
+    int last = beam->plies - 1, pos = beam->pos + last,
+        cands = 0, kept = 0, n, m, lines;
+    const State *parent = ply_state(beam, last);
+    State *child;
+    const Piece *piece;
+
+    if(last >= beam->horizon || pos >= beam->game->input_size)
+        return false;
+
+    piece = &beam->game->piece[game_input(beam->game, pos)];
+    for(n = 0; n < *ply_count(beam, last); ++n)
+        for(m = 0; m < piece->moves; ++m)
+        {
+            const Move *move = &piece->move[m];
+            Field field = parent[n].field;
+            Candidate *c = &beam->cand[cands];
+            lines = place(&field, &piece->form[move->form], move->xpos);
+            if(lines < 0)
+                continue;
+            c->value  = evaluate(&field, parent[n].score + lines_score[lines]);
+            c->order  = cands++;
+            c->parent = n;
+            c->move   = *move;
+            c->hash   = field.hash;
+        }
+    if(cands == 0)
+        return false;
+
+    qsort(beam->cand, cands, sizeof(*beam->cand), compare_candidates);
+    memset(beam->seen, 0, (beam->seen_mask + 1)*sizeof(*beam->seen));
+
+    child = ply_state(beam, last + 1);
+    for(n = 0; n < cands && kept < beam->width; ++n)
+    {
+        const Candidate *c = &beam->cand[n];
+        State *s;
+
+        if(!mark_seen(beam, c->hash))
+            continue;
+        s = &child[kept++];
+        s->field  = parent[c->parent].field;
+        lines     = place(&s->field, &piece->form[c->move.form], c->move.xpos);
+        s->score  = parent[c->parent].score + lines_score[lines];
+        s->value  = c->value;
+        s->parent = c->parent;
+        s->move   = c->move;
+    }
+    *ply_count(beam, last + 1) = kept;
+    ++beam->plies;
+    return true;
+}
+
+/* Commits to the first move towards the best state in the last ply: its
+   ancestor in ply 1 becomes the new root and all states that do not
+   descend from it are dropped. */
+static void commit(Beam *beam, Move *move)
+{
+    int last = beam->plies - 1, best = 0, ply, n, kept, offset;
+    int *prev = beam->map[0], *cur = beam->map[1], *tmp;
+    State *s = ply_state(beam, last);
+
+    for(n = 1; n < *ply_count(beam, last); ++n)
+        if(s[n].value > s[best].value)
+            best = n;
+    for(ply = last; ply > 1; --ply)
+        best = ply_state(beam, ply)[best].parent;
+
+    s = ply_state(beam, 1);
+    for(n = 0; n < *ply_count(beam, 1); ++n)
+        prev[n] = (n == best) ? 0 : -1;
+    *move  = s[best].move;
+    offset = s[best].score;
+    s[0] = s[best];
+    *ply_count(beam, 1) = 1;
+
+    for(ply = 2; ply <= last; ++ply)
+    {
+        s = ply_state(beam, ply);
+        for(n = kept = 0; n < *ply_count(beam, ply); ++n)
+        {
+            if(prev[s[n].parent] < 0)
+            {
+                cur[n] = -1;
+                continue;
+            }
+            cur[n] = kept;
+            s[kept] = s[n];
+            s[kept].parent = prev[s[n].parent];
+            ++kept;
+        }
+        *ply_count(beam, ply) = kept;
+        tmp  = prev;
+        prev = cur;
+        cur  = tmp;
+    }
+
+    /* Keep scores relative to the new root, so they cannot overflow */
+    for(ply = 1; ply <= last; ++ply)
+    {
+        s = ply_state(beam, ply);
+        for(n = 0; n < *ply_count(beam, ply); ++n)
+        {
+            s[n].score -= offset;
+            s[n].value -= offset;
+        }
+    }
+
+    beam->first = (beam->first + 1)%(beam->horizon + 1);
+    --beam->plies;
+    ++beam->pos;
+}
+
+/* Extends the lookahead up to the horizon and selects the next move.
+   Returns false if no valid move exists. */
+bool beam_next_move(Beam *beam, Move *move)
+{
+    while(expand(beam))
+        continue;
+    if(beam->plies < 2)
+        return false;
+    commit(beam, move);
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef BEAM_H
+#define BEAM_H
+
+#include "Base.h"
+
+/* Beam search over the known piece sequence: keeps the best 'width' states
+   of each of the next 'horizon' pieces, and extends the lookahead by one
+   piece each time a move is committed. */
+typedef struct Beam Beam;
+
+Beam *beam_create(const Game *game, int width, int horizon);
+void beam_destroy(Beam *beam);
+bool beam_next_move(Beam *beam, Move *move);
+
+#endif /* ndef BEAM_H */
@@ -0,0 +1,244 @@
+#include "Base.h"
+#include "Eval.h"
+#include "Search.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_GAMES            1024
+
+/* Measurements of a single game, passed from the process that played it
+   back to the driver. */
+typedef struct Result
+{
+    int         pieces, score;
+    long long   time, nodes, places;    /* time in microseconds */
+    long        peak_rss;               /* in kilobytes */
+} Result;
+
+static int threads = 1, table_size = TABLE_SIZE;
+static Policy policy;
+static bool json, exhaustive;
+
+/* Plays a game like the Player does (without GUI or move output), filling
+   in 'result'. Returns false if the game could not be played. */
+static bool play(const char *dir, Result *result)
+{
+    Field field = { };
+    Stats stats = { };
+    Searcher searcher = { };
+    struct rusage usage;
+    Game *game;
+    long long t;
+
+    game = load_game(dir);
+    if(!game)
+        return false;
+
+    searcher.game = game;
+    searcher.exhaustive = exhaustive;
+    if(table_size > 0)
+    {
+        searcher.table = table_create((size_t)table_size << 20);
+        if(!searcher.table)
+        {
+            fprintf(stderr, "Could not allocate transposition table!\n");
+            return false;
+        }
+    }
+    if(!search_create_threads(threads))
+    {
+        fprintf(stderr, "Could not create search threads!\n");
+        return false;
+    }
+
+    t = utime();
+    for(stats.pos = 0; stats.pos < game->input_size; ++stats.pos)
+    {
+        Move best_move;
+        int reached;
+        bool found;
+
+        PROFILE_START(&searcher.profile);
+        found = choose_move( &searcher, &policy, &field, &stats, utime() - t,
+                             &best_move, &reached );
+        PROFILE_STOP(&searcher.profile);
+        if(!found)
+            break;
+        if(!apply_move(&field, NULL, game, best_move, &stats))
+        {
+            fprintf(stderr, "INTERNAL ERROR: invalid move selected!\n");
+            return false;
+        }
+    }
+    result->time = utime() - t;
+
+    search_destroy_threads();
+    if(searcher.table)
+        table_destroy(searcher.table);
+
+    print_profile(stderr, &searcher.profile, searcher.nodes, searcher.places);
+    getrusage(RUSAGE_SELF, &usage);
+    result->pieces   = stats.pos;
+    result->score    = final_score(&stats);
+    result->nodes    = searcher.nodes;
+    result->places   = searcher.places;
+    result->peak_rss = usage.ru_maxrss;
+    return true;
+}
+
+/* Plays a game in a child process, so its peak memory use can be measured
+   separately from that of other games. */
+static bool run_game(const char *dir, Result *result)
+{
+    int fd[2], status;
+    bool ok;
+    pid_t pid;
+
+    if(pipe(fd) != 0)
+        return false;
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0)
+    {
+        close(fd[0]);
+        close(fd[1]);
+        return false;
+    }
+    if(pid == 0)
+    {
+        close(fd[0]);
+        ok = play(dir, result) &&
+             write(fd[1], result, sizeof(*result)) == sizeof(*result);
+        _exit(ok ? 0 : 1);
+    }
+    close(fd[1]);
+    ok = read(fd[0], result, sizeof(*result)) == sizeof(*result);
+    close(fd[0]);
+    if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+       WEXITSTATUS(status) != 0)
+        ok = false;
+    return ok;
+}
+
+static double rate(long long count, long long time)
+{
+    return time > 0 ? 1e6*count/time : 0;
+}
+
+static void print_header(void)
+{
+    if(json)
+        printf( "{\n  \"threads\": %d, \"depth\": %d, \"table_mb\": %d,\n"
+                "  \"games\": [\n", threads, policy.depth, table_size );
+    else
+        printf( "game,pieces,score,time_ms,pieces_per_sec,nodes,nodes_per_sec,"
+                "places,places_per_sec,peak_rss_kb\n" );
+}
+
+/* Prints the measurements of a game (or their totals), preceded by 'sep'
+   in JSON output. */
+static void print_result(const char *sep, const char *name, const Result *r)
+{
+    if(json)
+        printf( "%s{ \"game\": \"%s\", \"pieces\": %d, \"score\": %d, "
+                "\"time_ms\": %.1f, \"pieces_per_sec\": %.1f, "
+                "\"nodes\": %lld, \"nodes_per_sec\": %.0f, "
+                "\"places\": %lld, \"places_per_sec\": %.0f, "
+                "\"peak_rss_kb\": %ld }",
+                sep, name, r->pieces, r->score, r->time/1e3,
+                rate(r->pieces, r->time), r->nodes, rate(r->nodes, r->time),
+                r->places, rate(r->places, r->time), r->peak_rss );
+    else
+        printf( "%s,%d,%d,%.1f,%.1f,%lld,%.0f,%lld,%.0f,%ld\n",
+                name, r->pieces, r->score, r->time/1e3,
+                rate(r->pieces, r->time), r->nodes, rate(r->nodes, r->time),
+                r->places, rate(r->places, r->time), r->peak_rss );
+}
+
+static void print_total(const Result *total, int games, int failed)
+{
+    if(json)
+    {
+        printf("\n  ],\n  \"total\": ");
+        print_result("", "total", total);
+        printf(",\n  \"games_played\": %d, \"games_failed\": %d\n}\n", games, failed);
+    }
+    else
+        print_result("", "total", total);
+}
+
+int main(int argc, char *argv[])
+{
+    static char name[MAX_GAMES][MAX_GAME_NAME];
+    const char *corpus = NULL;
+    char path[1024];
+    Result result, total = { };
+    int games = 0, played = 0, failed = 0, len, n, used;
+
+    for(n = 1; n < argc; ++n)
+    {
+        if((used = policy_parse(&policy, argc, argv, n)) < 0)
+            return 1;
+        else
+        if(used > 0)
+            n += used - 1;
+        else
+        if(strcmp(argv[n], "-j") == 0 && n + 1 < argc)
+            threads = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-t") == 0 && n + 1 < argc)
+            table_size = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-w") == 0 && n + 1 < argc)
+        {
+            if(!load_weights(argv[++n]))
+            {
+                fprintf(stderr, "Could not load weights from \"%s\"!\n", argv[n]);
+                return 1;
+            }
+        }
+        else
+        if(strcmp(argv[n], "-x") == 0)
+            exhaustive = true;
+        else
+        if(strcmp(argv[n], "-f") == 0 && n + 1 < argc)
+            json = strcmp(argv[++n], "json") == 0;
+        else
+            corpus = argv[n];
+    }
+    if(!corpus)
+    {
+        fprintf( stderr, "Usage: %s [-j threads] " POLICY_USAGE " "
+                         "[-t table MB] [-w weights] [-x] "
+                         "[-f csv|json] <directory of games>\n", argv[0] );
+        return 1;
+    }
+
+    policy_normalize(&policy);
+    games = find_games(corpus, name, MAX_GAMES);
+    if(games < 0)
+        return 1;
+
+    print_header();
+    len = sprintf(path, "%s/", corpus);
+    for(n = 0; n < games; ++n)
+    {
+        strcpy(path + len, name[n]);
+        if(!run_game(path, &result))
+        {
+            fprintf(stderr, "Failed to play game \"%s\"!\n", path);
+            ++failed;
+            continue;
+        }
+        print_result(played++ ? ",\n    " : "    ", name[n], &result);
+        total.pieces += result.pieces;
+        total.score  += result.score;
+        total.time   += result.time;
+        total.nodes  += result.nodes;
+        total.places += result.places;
+        if(result.peak_rss > total.peak_rss)
+            total.peak_rss = result.peak_rss;
+    }
+    print_total(&total, played, failed);
+    return failed ? 1 : 0;
+}
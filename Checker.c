@@ -1,95 +1,456 @@
 #include "Base.h"
 #include "Gui.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-bool process(Game *game, FILE *input, GUI *gui)
+#define BLOCK_SIZE      (1 << 20)   /* read size if the input cannot be mapped */
+#define MAX_LINE        16          /* longer than any valid instruction */
+#define MAX_ERROR      256
+#define MAX_PATH      1024
+#define KEYFRAME_INTERVAL 1000      /* pieces between replay keyframes */
+
+enum Instruction
 {
-    char line[64];
-    Field field = { };
-    Stats stats = { };
+    INSTR_INVALID, INSTR_MOVE_LEFT, INSTR_MOVE_RIGHT, INSTR_ROTATE_CCW,
+    INSTR_ROTATE_CW, INSTR_NEW_BLOCK, INSTR_DROP, INSTR_DEBUG, INSTR_DISCARD,
+    INSTR_END
+};
+
+/* The instruction stream: either the whole input mapped into memory, or a
+   buffer that is refilled with large blocks. */
+typedef struct Input
+{
+    int     fd;
+    char    *data;
+    size_t  pos, size;
+    bool    mapped, eof;
+} Input;
+
+static bool open_input(Input *in, int fd)
+{
+    struct stat st;
+
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        in->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(in->data != MAP_FAILED)
+        {
+            in->size   = st.st_size;
+            in->mapped = in->eof = true;
+            return true;
+        }
+    }
+    in->data = malloc(BLOCK_SIZE);
+    return in->data != NULL;
+}
+
+static void close_input(Input *in)
+{
+    if(in->mapped)
+        munmap(in->data, in->size);
+    else
+        free(in->data);
+}
+
+/* Moves the unread data to the front of the buffer and fills the rest. */
+static void refill(Input *in)
+{
+    ssize_t n;
+
+    in->size -= in->pos;
+    memmove(in->data, in->data + in->pos, in->size);
+    in->pos = 0;
+    while(!in->eof && in->size < BLOCK_SIZE)
+    {
+        n = read(in->fd, in->data + in->size, BLOCK_SIZE - in->size);
+        if(n <= 0)
+            in->eof = true;
+        else
+            in->size += n;
+    }
+}
+
+/* Consumes the line 's' (of 'len' characters, including the newline) if
+   the input continues with it. */
+static int accept(Input *in, const char *s, size_t len, int instr)
+{
+    const char *p = in->data + in->pos;
+    size_t n;
+
+    if(in->size - in->pos < len)
+        return INSTR_INVALID;
+    for(n = 0; n < len; ++n)
+        if(p[n] != s[n])
+            return INSTR_INVALID;
+    in->pos += len;
+    return instr;
+}
+
+/* Reads the next instruction, dispatching on its first characters. Lines
+   that do not match an instruction exactly (including the newline) are
+   invalid, and since they end processing, are not consumed. */
+static int next_instruction(Input *in)
+{
+    const char *p;
+
+    if(in->size - in->pos < MAX_LINE && !in->eof)
+        refill(in);
+    if(in->pos == in->size)
+        return INSTR_END;
+
+    p = in->data + in->pos;
+    switch(p[0])
+    {
+    case 'M':
+        if(in->size - in->pos > 5 && p[5] == 'L')
+            return accept(in, "MOVE LEFT\n", 10, INSTR_MOVE_LEFT);
+        return accept(in, "MOVE RIGHT\n", 11, INSTR_MOVE_RIGHT);
+    case 'R':
+        if(in->size - in->pos > 8 && p[8] == 'C')
+            return accept(in, "ROTATE CCW\n", 11, INSTR_ROTATE_CCW);
+        return accept(in, "ROTATE CW\n", 10, INSTR_ROTATE_CW);
+    case 'N':
+        return accept(in, "NEW BLOCK\n", 10, INSTR_NEW_BLOCK);
+    case 'D':
+        if(in->size - in->pos > 1)
+            switch(p[1])
+            {
+            case 'R': return accept(in, "DROP\n", 5, INSTR_DROP);
+            case 'E': return accept(in, "DEBUG\n", 6, INSTR_DEBUG);
+            case 'I': return accept(in, "DISCARD\n", 8, INSTR_DISCARD);
+            }
+    }
+    return INSTR_INVALID;
+}
+
+/* A piece of a replayed solution: the form dropped (or -1 if the piece was
+   discarded), its position, the number of lines it cleared and the number
+   of instructions up to and including the drop or discard. */
+typedef struct ReplayMove
+{
+    int         instr;
+    signed char form, xpos, lines;
+} ReplayMove;
+
+/* The state before piece n*interval of a replay. Tile ids fit in four bits
+   and are stored two per byte. */
+typedef struct Keyframe
+{
+    Field           field;
+    Stats           stats;
+    unsigned char   tiles[FIELD_WIDTH*FIELD_HEIGHT/2];
+} Keyframe;
+
+/* The moves of a solution with a keyframe every 'interval' pieces, so any
+   position is reached from the nearest keyframe by at most interval - 1
+   placements. */
+typedef struct Replay
+{
+    int         interval, moves;
+    ReplayMove  *move;
+    Keyframe    *keyframe;
+} Replay;
+
+static void store_keyframe( Keyframe *key, const Field *field,
+                            const Tiles *tiles, const Stats *stats )
+{
+    const char *tile = &tiles->tile[0][0];
+    int n;
+
+    key->field = *field;
+    key->stats = *stats;
+    for(n = 0; n < FIELD_WIDTH*FIELD_HEIGHT/2; ++n)
+        key->tiles[n] = tile[2*n] | tile[2*n + 1] << 4;
+}
+
+static void load_keyframe( const Keyframe *key, Field *field,
+                           Tiles *tiles, Stats *stats )
+{
+    char *tile = &tiles->tile[0][0];
+    int n;
+
+    *field = key->field;
+    *stats = key->stats;
+    for(n = 0; n < FIELD_WIDTH*FIELD_HEIGHT/2; ++n)
+    {
+        tile[2*n]     = key->tiles[n] & 15;
+        tile[2*n + 1] = key->tiles[n] >> 4;
+    }
+}
+
+/* Records the move of the piece that was just dropped or discarded, and
+   stores a keyframe if the next piece starts a new interval. */
+static void record_move( Replay *replay, int form, int xpos, int lines,
+                         const Field *field, const Tiles *tiles,
+                         const Stats *stats )
+{
+    ReplayMove *move = &replay->move[replay->moves++];
+
+    move->instr = stats->instr;
+    move->form  = form;
+    move->xpos  = xpos;
+    move->lines = lines;
+    if(replay->moves%replay->interval == 0)
+        store_keyframe( &replay->keyframe[replay->moves/replay->interval],
+                        field, tiles, stats );
+}
+
+/* The field being checked and its tiles, which are only kept up to date
+   when the field is displayed or replayed. Owned by the caller of check(),
+   so the GUI may show the final state after checking. */
+typedef struct Board
+{
+    Field field;
+    Tiles tiles;
+} Board;
+
+/* Consumes the binary move file header if the input starts with it. */
+static bool accept_magic(Input *in)
+{
+    if(in->size - in->pos < MAGIC_SIZE && !in->eof)
+        refill(in);
+    if( in->size - in->pos < MAGIC_SIZE ||
+        memcmp(in->data + in->pos, MOVES_MAGIC, MAGIC_SIZE) != 0 )
+        return false;
+    in->pos += MAGIC_SIZE;
+    return true;
+}
+
+/* Validates binary move records like check() validates instructions,
+   counting each record as one instruction. */
+static void check_records( Game *game, Input *in, GUI *gui, Board *board,
+                           Stats *stats, char *error, Replay *replay )
+{
+    Field *field = &board->field;
+    Tiles *tiles = &board->tiles;
+    Piece *piece;
+    int record, rotation, xpos, score, lines;
+
+    error[0] = '\0';
+    if(gui)
+        gui_update(gui, field, tiles, stats, NULL, 0);
+    if(replay)
+        store_keyframe(&replay->keyframe[0], field, tiles, stats);
+
+    while(stats->pos < game->input_size)
+    {
+        if(in->pos == in->size && !in->eof)
+            refill(in);
+        if(in->pos == in->size)
+            break;
+        record = (unsigned char)in->data[in->pos++];
+        ++stats->instr;
+        piece = &game->piece[game_input(game, stats->pos)];
+
+        if(record == DISCARD_RECORD)
+        {
+            if(stats->discarded >= MAX_DISCARDS)
+            {
+                sprintf( error, "May not discard piece "
+                    "at record %d (piece %d)\n", stats->instr, stats->pos );
+                break;
+            }
+            ++stats->discarded;
+            ++stats->pos;
+            if(replay)
+                record_move(replay, -1, 0, 0, field, tiles, stats);
+            continue;
+        }
+
+        rotation = record >> 4;
+        xpos     = record & 15;
+        if(rotation > 3)
+        {
+            sprintf( error, "Invalid record %d at record %d (piece %d)!\n",
+                record, stats->instr, stats->pos );
+            break;
+        }
+        if(xpos + piece->form[rotation].width > FIELD_WIDTH)
+        {
+            sprintf( error, "Piece with position %d and rotation %d "
+                "is outside field at record %d (piece %d)!\n",
+                xpos, rotation, stats->instr, stats->pos );
+            break;
+        }
+
+        if(gui)
+            gui_update(gui, field, tiles, stats, &piece->form[rotation], xpos);
+
+        score = stats->score;
+        if(!update_field( field, gui || replay ? tiles : NULL,
+                          &piece->form[rotation], xpos, stats ))
+        {
+            sprintf( error, "Piece does not fit with position %d "
+                "and rotation %d at record %d (piece %d)!\n",
+                xpos, rotation, stats->instr, stats->pos );
+            break;
+        }
+        ++stats->pos;
+        if(replay)
+        {
+            lines = 0;
+            while(lines_score[lines] != stats->score - score)
+                ++lines;
+            record_move(replay, rotation, xpos, lines, field, tiles, stats);
+        }
+    }
+}
+
+/* Validates the instructions in 'in', counting them and the pieces placed
+   in 'stats'. On an error, it is described in 'error' (of at least
+   MAX_ERROR characters) and processing stops; otherwise 'error' is set to
+   the empty string. If 'replay' is given, the moves of all valid pieces
+   are recorded in it. Input in the binary move format is passed on to
+   check_records(). */
+static void check( Game *game, Input *in, GUI *gui, Board *board,
+                   Stats *stats, char *error, Replay *replay )
+{
+    Field *field = &board->field;
+    Tiles *tiles = &board->tiles;
     Piece *cur = NULL;
-    int rotation = 0, translation = 0;
+    int rotation = 0, translation = 0, instr, last = INSTR_INVALID,
+        score, lines;
+    bool end = false;
 
+    if(accept_magic(in))
+    {
+        check_records(game, in, gui, board, stats, error, replay);
+        return;
+    }
+
+    error[0] = '\0';
     if(gui)
-        gui_update(gui, &field, &stats, NULL, 0);
+        gui_update(gui, field, tiles, stats, NULL, 0);
+    if(replay)
+        store_keyframe(&replay->keyframe[0], field, tiles, stats);
 
-    while(!feof(input) && (cur || stats.pos < game->input_size))
+    while(!end && (cur || stats->pos < game->input_size))
     {
-        fgets(line, sizeof(line), input);
-        ++stats.instr;
+        /* At the end of the input, the last line is processed once more
+           before stopping, as the line-based checker did */
+        instr = next_instruction(in);
+        if(instr == INSTR_END)
+        {
+            end = true;
+            instr = last;
+        }
+        last = instr;
+        ++stats->instr;
 
-        if(cur && strcmp(line, "MOVE LEFT\n") == 0)
+        if(cur && instr == INSTR_MOVE_LEFT)
             translation -= 1;
         else
-        if(cur && strcmp(line, "MOVE RIGHT\n") == 0)
+        if(cur && instr == INSTR_MOVE_RIGHT)
             translation += 1;
         else
-        if(cur && strcmp(line, "ROTATE CCW\n") == 0)
+        if(cur && instr == INSTR_ROTATE_CCW)
             rotation = (rotation + 1)%4;
         else
-        if(cur && strcmp(line, "ROTATE CW\n") == 0)
+        if(cur && instr == INSTR_ROTATE_CW)
             rotation = (rotation + 3)%4;
         else
-        if(!cur && strcmp(line, "NEW BLOCK\n") == 0)
+        if(!cur && instr == INSTR_NEW_BLOCK)
         {
             rotation = translation = 0;
-            cur = &game->piece[(int)game->input[stats.pos]];
+            cur = &game->piece[game_input(game, stats->pos)];
         }
         else
-        if(cur && strcmp(line, "DROP\n") == 0)
+        if(cur && instr == INSTR_DROP)
         {
             int xpos = translation - cur->form[rotation].translation;
             if(xpos < 0 || xpos + cur->form[rotation].width > FIELD_WIDTH)
             {
-                fprintf( stderr, "Piece with translation %d and rotation %d "
+                sprintf( error, "Piece with translation %d and rotation %d "
                     "is outside field at instruction %d (piece %d)!\n",
-                    translation, rotation, stats.instr, stats.pos );
+                    translation, rotation, stats->instr, stats->pos );
                 break;
             }
 
             if(gui)
-                gui_update(gui, &field, &stats, &cur->form[rotation], xpos);
+                gui_update( gui, field, tiles, stats,
+                            &cur->form[rotation], xpos );
 
-            if(!update_field(&field, &cur->form[rotation], xpos, &stats))
+            score = stats->score;
+            if(!update_field( field, gui || replay ? tiles : NULL,
+                              &cur->form[rotation], xpos, stats ))
             {
-                fprintf( stderr, "Piece does not fit with translation %d "
+                sprintf( error, "Piece does not fit with translation %d "
                     "and rotation %d at instruction %d (piece %d)!\n",
-                    translation, rotation, stats.instr, stats.pos );
+                    translation, rotation, stats->instr, stats->pos );
                 break;
             }
             cur = NULL;
-            ++stats.pos;
+            ++stats->pos;
+            if(replay)
+            {
+                lines = 0;
+                while(lines_score[lines] != stats->score - score)
+                    ++lines;
+                record_move( replay, rotation, xpos, lines,
+                             field, tiles, stats );
+            }
         }
         else
-        if(strcmp(line, "DEBUG\n") == 0)
+        if(instr == INSTR_DEBUG)
         {
             /*
             fprintf( stderr, "Debug at instruction %d (piece %d)\n",
-                     stats.instr, stats.pos );
+                     stats->instr, stats->pos );
             */
         }
         else
-        if(cur && strcmp(line, "DISCARD\n") == 0)
+        if(cur && instr == INSTR_DISCARD)
         {
-            if(stats.discarded >= 5)
+            if(stats->discarded >= MAX_DISCARDS)
             {
-                fprintf( stderr, "May not discard piece "
-                    "at instruction %d (piece %d)\n", stats.instr, stats.pos );
+                sprintf( error, "May not discard piece "
+                    "at instruction %d (piece %d)\n", stats->instr, stats->pos );
                 break;
             }
-            ++stats.discarded;
+            ++stats->discarded;
             cur = NULL;
-            ++stats.pos;
+            ++stats->pos;
+            if(replay)
+                record_move(replay, -1, 0, 0, field, tiles, stats);
         }
         else
         {
-            fprintf( stderr, "Unexpected input at "
-                "instruction %d (piece %d)\n", stats.instr, stats.pos );
+            sprintf( error, "Unexpected input at "
+                "instruction %d (piece %d)\n", stats->instr, stats->pos );
             break;
         }
     }
+}
 
+bool process(Game *game, int input, GUI *gui)
+{
+    char error[MAX_ERROR];
+    Input in;
+    Board board = { };
+    Stats stats = { };
+    long long t = utime();
+
+    if(!open_input(&in, input))
+    {
+        fprintf(stderr, "Could not allocate input buffer!\n");
+        return false;
+    }
+    check(game, &in, gui, &board, &stats, error, NULL);
+    t = utime() - t;
+    close_input(&in);
+
+    if(error[0])
+        fprintf(stderr, "%s", error);
     print_stats(stdout, &stats);
     fflush(stdout);
+    fprintf( stderr,
+        "Checking time (ms):        %8lld\n"
+        "Lines per second:          %8.0f\n",
+        t/1000, t > 0 ? 1e6*stats.instr/t : 0.0 );
 
     if(gui)
         gui_wait(gui);
@@ -97,20 +458,324 @@ bool process(Game *game, FILE *input, GUI *gui)
     return true;
 }
 
+/* Restores the state before piece 'pos' of a replay: loads the keyframe at
+   or before it and replays the remaining moves. */
+static void seek( Game *game, const Replay *replay, int pos,
+                  Field *field, Tiles *tiles, Stats *stats )
+{
+    const ReplayMove *move;
+    int n;
+
+    load_keyframe(&replay->keyframe[pos/replay->interval], field, tiles, stats);
+    for(n = pos - pos%replay->interval; n < pos; ++n)
+    {
+        move = &replay->move[n];
+        if(move->form < 0)
+            ++stats->discarded;
+        else
+            update_field( field, tiles,
+                          &game->piece[game_input(game, n)].form[(int)move->form],
+                          move->xpos, stats );
+        stats->instr = move->instr;
+        stats->pos = n + 1;
+    }
+}
+
+/* Returns the next (if 'step' is 1) or previous (if 'step' is -1) piece
+   after 'pos' that cleared lines (or was discarded, if 'discards' is set),
+   or 'pos' if there is none. */
+static int find_move(const Replay *replay, int pos, int step, bool discards)
+{
+    int n;
+
+    for(n = pos + step; n >= 0 && n < replay->moves; n += step)
+        if(discards ? replay->move[n].form < 0 : replay->move[n].lines > 0)
+            return n;
+    return pos;
+}
+
+/* Checks a solution like process(), then shows it in a viewer that can
+   seek to any piece: Left/Right step one piece, Page Up/Page Down step
+   'interval' pieces, Home/End go to the start and end, Up/Down go to the
+   previous and next piece that clears lines, and D to the next discard. */
+bool view_replay(Game *game, int input, GUI *gui, int interval, int start)
+{
+    char error[MAX_ERROR];
+    Input in;
+    Board board = { };
+    Replay replay;
+    Field field;
+    Tiles tiles;
+    Stats stats = { };
+    const ReplayMove *move;
+    long long t = utime();
+    int pos;
+    GuiKey key;
+
+    if(interval < 1)
+        interval = 1;
+    replay.interval = interval;
+    replay.moves    = 0;
+    replay.move     = malloc((game->input_size + 1)*sizeof(*replay.move));
+    replay.keyframe = malloc( (game->input_size/interval + 1)*
+                              sizeof(*replay.keyframe) );
+    if(!replay.move || !replay.keyframe || !open_input(&in, input))
+    {
+        fprintf(stderr, "Could not allocate replay buffers!\n");
+        free(replay.move);
+        free(replay.keyframe);
+        return false;
+    }
+    check(game, &in, NULL, &board, &stats, error, &replay);
+    t = utime() - t;
+    close_input(&in);
+
+    if(error[0])
+        fprintf(stderr, "%s", error);
+    print_stats(stdout, &stats);
+    fflush(stdout);
+    fprintf( stderr,
+        "Checking time (ms):        %8lld\n"
+        "Keyframes:                 %8d\n",
+        t/1000, replay.moves/interval + 1 );
+
+    gui_set_update_delay(gui, 0);
+    pos = start < 0 ? 0 : start > replay.moves ? replay.moves : start;
+    do {
+        seek(game, &replay, pos, &field, &tiles, &stats);
+        move = pos < replay.moves ? &replay.move[pos] : NULL;
+        if(move && move->form >= 0)
+            gui_update( gui, &field, &tiles, &stats,
+                        &game->piece[game_input(game, pos)].form[(int)move->form],
+                        move->xpos );
+        else
+            gui_update(gui, &field, &tiles, &stats, NULL, 0);
+
+        key = gui_read_key(gui);
+        switch(key)
+        {
+        case KEY_LEFT:      pos -= 1;                                   break;
+        case KEY_RIGHT:     pos += 1;                                   break;
+        case KEY_PAGE_UP:   pos -= interval;                            break;
+        case KEY_PAGE_DOWN: pos += interval;                            break;
+        case KEY_HOME:      pos = 0;                                    break;
+        case KEY_END:       pos = replay.moves;                         break;
+        case KEY_UP:        pos = find_move(&replay, pos, -1, false);   break;
+        case KEY_DOWN:      pos = find_move(&replay, pos, 1, false);    break;
+        case KEY_DISCARD:   pos = find_move(&replay, pos, 1, true);     break;
+        default:                                                        break;
+        }
+        if(pos < 0)
+            pos = 0;
+        if(pos > replay.moves)
+            pos = replay.moves;
+    } while(key != KEY_ESCAPE);
+
+    free(replay.move);
+    free(replay.keyframe);
+    return true;
+}
+
+/* A (game, solution) pair of a batch, and the result of checking it. */
+typedef struct Job
+{
+    char    dir[MAX_PATH], solution[MAX_PATH];
+    Game    *game;                      /* shared by jobs with the same dir */
+    Stats   stats;
+    char    error[MAX_ERROR];
+} Job;
+
+static Job *jobs;
+static int num_jobs, next_job;
+
+static void run_job(Job *job)
+{
+    Board board = { };
+    Input in;
+    int fd;
+
+    if(!job->game)
+    {
+        sprintf(job->error, "Could not load game.\n");
+        return;
+    }
+    fd = open(job->solution, O_RDONLY);
+    if(fd < 0)
+    {
+        sprintf(job->error, "Unable to open solution file!\n");
+        return;
+    }
+    if(!open_input(&in, fd))
+        sprintf(job->error, "Could not allocate input buffer!\n");
+    else
+    {
+        check(job->game, &in, NULL, &board, &job->stats, job->error, NULL);
+        close_input(&in);
+    }
+    close(fd);
+}
+
+static void *batch_worker(void *arg)
+{
+    int n;
+
+    while((n = __sync_fetch_and_add(&next_job, 1)) < num_jobs)
+        run_job(&jobs[n]);
+    return NULL;
+}
+
+/* Reads the (game directory, solution file) pairs listed in a manifest,
+   one pair per line separated by whitespace. Empty lines and lines
+   starting with '#' are skipped. */
+static bool read_manifest(const char *path)
+{
+    char line[2*MAX_PATH + 16], fmt[32];
+    FILE *fp = fopen(path, "rt");
+    int size = 0, n;
+
+    if(!fp)
+    {
+        fprintf(stderr, "Unable to open manifest \"%s\"!\n", path);
+        return false;
+    }
+    sprintf(fmt, "%%%ds %%%ds", MAX_PATH - 1, MAX_PATH - 1);
+    for(n = 1; fgets(line, sizeof(line), fp); ++n)
+    {
+        Job *job;
+
+        if(line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#')
+            continue;
+        if(num_jobs == size)
+        {
+            size = size ? 2*size : 256;
+            jobs = realloc(jobs, size*sizeof(*jobs));
+            if(!jobs)
+            {
+                fprintf(stderr, "Could not allocate jobs!\n");
+                fclose(fp);
+                return false;
+            }
+        }
+        job = &jobs[num_jobs];
+        memset(job, 0, sizeof(*job));
+        if(sscanf(line, fmt, job->dir, job->solution) != 2)
+        {
+            fprintf(stderr, "Invalid manifest entry at line %d!\n", n);
+            fclose(fp);
+            return false;
+        }
+        ++num_jobs;
+    }
+    fclose(fp);
+    return true;
+}
+
+/* Checks all pairs listed in a manifest using 'threads' threads, loading
+   each game only once, and prints one line per pair: game directory,
+   solution file, score, instruction count and the first error (if any). */
+static bool batch(const char *manifest, int threads)
+{
+    pthread_t *thread;
+    long long t, lines = 0;
+    int n, m, started, failed = 0;
+
+    if(!read_manifest(manifest))
+        return false;
+
+    for(n = 0; n < num_jobs; ++n)
+    {
+        for(m = 0; m < n; ++m)
+            if(strcmp(jobs[m].dir, jobs[n].dir) == 0)
+                break;
+        jobs[n].game = (m < n) ? jobs[m].game : load_game(jobs[n].dir);
+    }
+
+    t = utime();
+    if(threads < 1)
+        threads = 1;
+    thread = calloc(threads, sizeof(*thread));
+    for(started = 1; thread && started < threads; ++started)
+        if(pthread_create(&thread[started], NULL, batch_worker, NULL) != 0)
+            break;
+    batch_worker(NULL);
+    for(n = 1; thread && n < started; ++n)
+        pthread_join(thread[n], NULL);
+    free(thread);
+    t = utime() - t;
+
+    for(n = 0; n < num_jobs; ++n)
+    {
+        Job *job = &jobs[n];
+        char *newline = strchr(job->error, '\n');
+
+        if(newline)
+            *newline = '\0';
+        printf( "%s\t%s\t%d\t%d\t%s\n", job->dir, job->solution,
+                final_score(&job->stats), job->stats.instr,
+                job->error[0] ? job->error : "OK" );
+        lines += job->stats.instr;
+        if(job->error[0])
+            ++failed;
+    }
+    fflush(stdout);
+    fprintf( stderr,
+        "Solutions checked:         %8d\n"
+        "Solutions with errors:     %8d\n"
+        "Checking time (ms):        %8lld\n"
+        "Lines per second:          %8.0f\n",
+        num_jobs, failed, t/1000, t > 0 ? 1e6*lines/t : 0.0 );
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
     Game *game;
     GUI *gui;
-    bool success;
+    const char *dir = ".", *manifest = NULL;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN), interval = KEYFRAME_INTERVAL,
+        start = 0, n;
+    bool success, replaying = false;
 
-    game = load_game((argc < 2) ? "." : argv[1]);
+    for(n = 1; n < argc; ++n)
+    {
+        if(strcmp(argv[n], "-b") == 0 && n + 1 < argc)
+            manifest = argv[++n];
+        else
+        if(strcmp(argv[n], "-j") == 0 && n + 1 < argc)
+            threads = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-r") == 0)
+            replaying = true;
+        else
+        if(strcmp(argv[n], "-k") == 0 && n + 1 < argc)
+            interval = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-p") == 0 && n + 1 < argc)
+            start = atoi(argv[++n]);
+        else
+            dir = argv[n];
+    }
+    if(manifest)
+        return batch(manifest, threads) ? 0 : 1;
+
+    game = load_game(dir);
     if(!game)
     {
         fprintf(stderr, "Could not load game.\n");
         return 1;
     }
     gui = gui_create(game, "Checker");
-    success = process(game, stdin, gui);
+    if(replaying)
+    {
+        if(!gui)
+        {
+            fprintf(stderr, "Could not create graphical user interface!\n");
+            return 1;
+        }
+        success = view_replay(game, STDIN_FILENO, gui, interval, start);
+    }
+    else
+        success = process(game, STDIN_FILENO, gui);
 
     if(gui)
         gui_destroy(gui);
@@ -0,0 +1,62 @@
+#include "Base.h"
+
+/* Converts a binary move file read from standard input to the instruction
+   text format. The game is streamed, so memory use does not depend on its
+   length. */
+int main(int argc, char *argv[])
+{
+    static Output output;
+    static unsigned char record[OUTPUT_SIZE];
+    Stats stats = { };
+    Game *game;
+    Move move;
+    size_t size, n;
+    bool header = false;
+
+    game = stream_game((argc < 2) ? "." : argv[1]);
+    if(!game)
+    {
+        fprintf(stderr, "Could not load game.\n");
+        return 1;
+    }
+    open_output(&output, STDOUT_FILENO, false);
+
+    while((size = fread(record, 1, sizeof(record), stdin)) > 0)
+    {
+        n = 0;
+        if(!header)
+        {
+            if(size < MAGIC_SIZE || memcmp(record, MOVES_MAGIC, MAGIC_SIZE) != 0)
+            {
+                fprintf(stderr, "Input is not a binary move file!\n");
+                return 1;
+            }
+            header = true;
+            n = MAGIC_SIZE;
+        }
+        for( ; n < size && has_piece(game, stats.pos); ++n, ++stats.pos)
+        {
+            if(record[n] == DISCARD_RECORD)
+                move.form = -1;
+            else
+            {
+                move.form = record[n] >> 4;
+                move.xpos = record[n] & 15;
+                if( move.form > 3 || move.xpos + game->piece[
+                        game_input(game, stats.pos)].form[move.form].width > FIELD_WIDTH )
+                {
+                    flush_output(&output);
+                    fprintf(stderr, "Invalid record at piece %d!\n", stats.pos);
+                    return 1;
+                }
+            }
+            write_move(&output, game, move, &stats);
+        }
+    }
+    if(!flush_output(&output))
+    {
+        fprintf(stderr, "Unable to write moves!\n");
+        return 1;
+    }
+    return 0;
+}
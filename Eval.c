@@ -0,0 +1,379 @@
+#include "Eval.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* The default weights give score - boundaries - squared column heights.
+   Cliffs are (2 + n)^2 for each height difference n > 2 between
+   neighbouring columns, holes are free tiles below the top of a column;
+   an alternative evaluation used heights 1, cliffs 1 and holes 50. */
+int weight[NUM_WEIGHTS] = { 1, 1, 1, 0, 0 };
+const char *weight_name[NUM_WEIGHTS] = {
+    "score", "boundaries", "heights", "cliffs", "holes" };
+
+/* Reads weights from lines of the form "name value"; weights that are not
+   listed keep their value. */
+bool load_weights(const char *path)
+{
+    char name[32];
+    int value, n;
+    FILE *fp = fopen(path, "rt");
+
+    if(!fp)
+        return false;
+    while(fscanf(fp, "%31s %d", name, &value) == 2)
+    {
+        for(n = 0; n < NUM_WEIGHTS; ++n)
+            if(strcmp(name, weight_name[n]) == 0)
+                break;
+        if(n == NUM_WEIGHTS)
+        {
+            fprintf(stderr, "Unknown weight \"%s\" in \"%s\"!\n", name, path);
+            fclose(fp);
+            return false;
+        }
+        weight[n] = value;
+    }
+    fclose(fp);
+    return true;
+}
+
+bool save_weights(const char *path, const int w[NUM_WEIGHTS])
+{
+    FILE *fp = fopen(path, "wt");
+    int n;
+
+    if(!fp)
+        return false;
+    for(n = 0; n < NUM_WEIGHTS; ++n)
+        fprintf(fp, "%s %d\n", weight_name[n], w[n]);
+    return fclose(fp) == 0;
+}
+
+/* Returns the weighted cliff and hole terms, which are not maintained by
+   place() and only computed when they have a weight. */
+static int shape_terms(const Field *field)
+{
+    int x, y, n, cliffs = 0, holes = 0;
+
+    if(weight[W_CLIFFS])
+        for(x = 1; x < FIELD_WIDTH; ++x)
+        {
+            n = field->top[x - 1] - field->top[x];
+            if(n < 0)
+                n = -n;
+            if(n > 2)
+                cliffs += (2 + n)*(2 + n);
+        }
+
+    /* Every occupied tile lies below the top of its column, and no tile
+       lies above an empty row */
+    if(weight[W_HOLES])
+    {
+        for(x = 0; x < FIELD_WIDTH; ++x)
+            holes += field->top[x];
+        for(y = 0; y < FIELD_HEIGHT && field->row[y]; ++y)
+            holes -= count_bits(field->row[y]);
+    }
+
+    return weight[W_CLIFFS]*cliffs + weight[W_HOLES]*holes;
+}
+
+static int weigh(int score, int boundaries, int heights)
+{
+    return weight[W_SCORE]*score - weight[W_BOUNDARIES]*boundaries -
+           weight[W_HEIGHTS]*heights;
+}
+
+/* Returns whether evaluate_bound() holds for the current weights, which
+   requires that no term but the score can raise the value of a field. */
+bool bound_admissible(void)
+{
+    int n;
+
+    for(n = 0; n < NUM_WEIGHTS; ++n)
+        if(weight[n] < 0)
+            return false;
+    return true;
+}
+
+/* Returns an upper bound on the value of any field reached from 'field'
+   by placing at most 'tiles' tiles, clearing at most 'lines' rows, with a
+   score of at most 'score'. Clearing rows removes at most 'lines' tiles of
+   a column, one per row, so the column keeps at least its tiles less
+   'lines', and its (lines + 1)th highest tile, lowered by at most 'lines'
+   rows; its top may drop further than that onto holes. Every row that is
+   not full has two horizontal boundaries, and every column one vertical
+   boundary unless it is filled to the top. */
+int evaluate_bound(const Field *field, int score, int lines, int tiles)
+{
+    int x, y, h, n, heights = 0, boundaries = EMPTY_BOUNDARIES;
+
+    for(x = 0; x < FIELD_WIDTH; ++x)
+    {
+        h = 0;
+        for(y = field->top[x] - 1, n = 0; y >= 0; --y)
+            if((field->row[y] >> x & 1) && ++n == lines + 1)
+                h = y + 1;
+        if(h < n)
+            h = n;
+        h -= lines;
+        if(h > 0)
+            heights += h*h;
+        if(field->top[x] + tiles >= FIELD_HEIGHT)
+            --boundaries;
+    }
+    return weigh(score, boundaries, heights);
+}
+
+/* Evaluates a field from the boundary count and squared heights that
+   place() keeps up to date. Debug builds check these against a full
+   recomputation. */
+int evaluate(const Field *field, int score)
+{
+    int value = weigh( score, EMPTY_BOUNDARIES + field->boundaries,
+                       field->heights );
+
+    if(weight[W_CLIFFS] || weight[W_HOLES])
+        value -= shape_terms(field);
+#ifdef DEBUG
+    if(value != evaluate_full(field, score))
+    {
+        fprintf( stderr, "INTERNAL ERROR: incremental evaluation (%d) "
+            "does not match full evaluation (%d)!\n",
+            value, evaluate_full(field, score) );
+        print_field(stderr, field);
+        abort();
+    }
+#endif
+    return value;
+}
+
+/* Plain implementation of the full evaluation. The vectorized versions
+   below must produce exactly the same values. */
+int evaluate_reference(const Field *field, int score)
+{
+    int x, y, boundaries = 0, h;
+
+    /* Count boundaries between tiles with different piece ids (0 for free
+       tiles), treating the walls and floor as occupied. */
+    for(y = 0; y < FIELD_HEIGHT; ++y)
+    {
+        if(!tile_id(field, 0, y))
+            ++boundaries;
+        if(!tile_id(field, FIELD_WIDTH - 1, y))
+            ++boundaries;
+        for(x = 1; x < FIELD_WIDTH; ++x)
+            if(tile_id(field, x - 1, y) != tile_id(field, x, y))
+                ++boundaries;
+    }
+
+    for(x = 0; x < FIELD_WIDTH; ++x)
+    {
+        if(!tile_id(field, x, 0))
+            ++boundaries;
+        for(y = 1; y < FIELD_HEIGHT; ++y)
+            if(tile_id(field, x, y - 1) != tile_id(field, x, y))
+                ++boundaries;
+    }
+
+    h = 0;
+    for(x = 0; x < FIELD_WIDTH; ++x)
+        h += field->top[x]*field->top[x];
+
+    return weigh(score, boundaries, h) - shape_terms(field);
+}
+
+#if defined(__SSE2__)
+
+#if FIELD_HEIGHT%8 != 0 || FIELD_WIDTH > 15
+#error "vectorized evaluation requires 8 | FIELD_HEIGHT and FIELD_WIDTH < 16"
+#endif
+
+/* Returns the boundary bits of eight rows: bits 0 through FIELD_WIDTH - 2
+   mark differences between neighbouring columns, the next two bits mark
+   free tiles next to the left and right wall. */
+static __m128i horizontal_edges(__m128i row)
+{
+    __m128i empty = _mm_xor_si128(row, _mm_set1_epi16(-1));
+    return _mm_or_si128(
+        _mm_and_si128( _mm_xor_si128(row, _mm_srli_epi16(row, 1)),
+                       _mm_set1_epi16(FULL_ROW >> 1) ),
+        _mm_or_si128(
+            _mm_and_si128( _mm_slli_epi16(empty, FIELD_WIDTH - 1),
+                           _mm_set1_epi16(1 << (FIELD_WIDTH - 1)) ),
+            _mm_and_si128( _mm_slli_epi16(empty, 1),
+                           _mm_set1_epi16((short)(1 << FIELD_WIDTH)) ) ) );
+}
+
+/* Counts the bits set in each byte. */
+static __m128i count_byte_bits(__m128i x)
+{
+    const __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33),
+                  m4 = _mm_set1_epi8(0x0F);
+    x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+    x = _mm_add_epi8( _mm_and_si128(x, m2),
+                      _mm_and_si128(_mm_srli_epi16(x, 2), m2) );
+    return _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
+}
+
+/* Adds the per-byte boundary counts of eight rows to 'acc'. */
+static __m128i add_boundaries(__m128i acc, __m128i row, __m128i below)
+{
+    acc = _mm_add_epi8(acc, count_byte_bits(horizontal_edges(row)));
+    return _mm_add_epi8(acc, count_byte_bits(_mm_xor_si128(row, below)));
+}
+
+static int sum_bytes(__m128i acc)
+{
+    acc = _mm_sad_epu8(acc, _mm_setzero_si128());
+    return _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+}
+
+/* Counts the boundaries between neighbouring occupied tiles with different
+   piece ids, which the occupancy counts below leave out. Below the first
+   row lies the floor, which has no piece id. */
+static int count_id_boundaries(const Field *field)
+{
+    __m128i acc = _mm_setzero_si128(), row, below, id, across, up;
+    int y, k;
+
+    for(y = 0; y < FIELD_HEIGHT; y += 8)
+    {
+        row   = _mm_loadu_si128((const __m128i*)(field->row + y));
+        below = y ? _mm_loadu_si128((const __m128i*)(field->row + y - 1))
+                  : _mm_slli_si128(row, 2);
+        across = up = _mm_setzero_si128();
+        for(k = 0; k < ID_BITS; ++k)
+        {
+            id = _mm_loadu_si128((const __m128i*)(field->id[k] + y));
+            across = _mm_or_si128(across, _mm_xor_si128(id, _mm_srli_epi16(id, 1)));
+            up = _mm_or_si128( up, _mm_xor_si128( id, y
+                ? _mm_loadu_si128((const __m128i*)(field->id[k] + y - 1))
+                : _mm_slli_si128(id, 2) ) );
+        }
+        across = _mm_and_si128( across,
+                    _mm_and_si128(row, _mm_srli_epi16(row, 1)) );
+        up = _mm_and_si128(up, _mm_and_si128(row, below));
+        acc = _mm_add_epi8(acc, count_byte_bits(across));
+        acc = _mm_add_epi8(acc, count_byte_bits(up));
+    }
+    return sum_bytes(acc);
+}
+
+#if defined(__AVX2__)
+
+static __m256i horizontal_edges256(__m256i row)
+{
+    __m256i empty = _mm256_xor_si256(row, _mm256_set1_epi16(-1));
+    return _mm256_or_si256(
+        _mm256_and_si256( _mm256_xor_si256(row, _mm256_srli_epi16(row, 1)),
+                          _mm256_set1_epi16(FULL_ROW >> 1) ),
+        _mm256_or_si256(
+            _mm256_and_si256( _mm256_slli_epi16(empty, FIELD_WIDTH - 1),
+                              _mm256_set1_epi16(1 << (FIELD_WIDTH - 1)) ),
+            _mm256_and_si256( _mm256_slli_epi16(empty, 1),
+                              _mm256_set1_epi16((short)(1 << FIELD_WIDTH)) ) ) );
+}
+
+static __m256i count_byte_bits256(__m256i x)
+{
+    const __m256i lut = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 );
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    return _mm256_add_epi8(
+        _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)),
+        _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)) );
+}
+
+static __m256i add_boundaries256(__m256i acc, __m256i row, __m256i below)
+{
+    acc = _mm256_add_epi8(acc, count_byte_bits256(horizontal_edges256(row)));
+    return _mm256_add_epi8(acc, count_byte_bits256(_mm256_xor_si256(row, below)));
+}
+
+static int count_boundaries(const Field *field)
+{
+    const Row *row = field->row;
+    __m256i acc = _mm256_setzero_si256(), cur, below;
+    __m128i tail = _mm_setzero_si128();
+    int y;
+
+    /* The first sixteen rows lie on the floor, which counts as occupied. */
+    cur   = _mm256_loadu_si256((const __m256i*)row);
+    below = _mm256_alignr_epi8(cur, _mm256_permute2x128_si256(cur, cur, 0x08), 14);
+    below = _mm256_or_si256(below, _mm256_setr_epi16(FULL_ROW, 0, 0, 0, 0, 0, 0, 0,
+                                                     0, 0, 0, 0, 0, 0, 0, 0));
+    acc = add_boundaries256(acc, cur, below);
+
+    for(y = 16; y + 16 <= FIELD_HEIGHT; y += 16)
+        acc = add_boundaries256( acc,
+            _mm256_loadu_si256((const __m256i*)(row + y)),
+            _mm256_loadu_si256((const __m256i*)(row + y - 1)) );
+
+    for( ; y < FIELD_HEIGHT; y += 8)
+        tail = add_boundaries( tail,
+            _mm_loadu_si128((const __m128i*)(row + y)),
+            _mm_loadu_si128((const __m128i*)(row + y - 1)) );
+
+    tail = _mm_add_epi8( tail, _mm_add_epi8( _mm256_castsi256_si128(acc),
+                                             _mm256_extracti128_si256(acc, 1) ) );
+    return sum_bytes(tail);
+}
+
+#else /* SSE2 only */
+
+static int count_boundaries(const Field *field)
+{
+    const Row *row = field->row;
+    __m128i acc = _mm_setzero_si128(), cur;
+    int y;
+
+    /* The first eight rows lie on the floor, which counts as occupied. */
+    cur = _mm_loadu_si128((const __m128i*)row);
+    acc = add_boundaries( acc, cur,
+        _mm_or_si128(_mm_slli_si128(cur, 2), _mm_cvtsi32_si128(FULL_ROW)) );
+
+    for(y = 8; y < FIELD_HEIGHT; y += 8)
+        acc = add_boundaries( acc,
+            _mm_loadu_si128((const __m128i*)(row + y)),
+            _mm_loadu_si128((const __m128i*)(row + y - 1)) );
+
+    return sum_bytes(acc);
+}
+
+#endif /* ndef __AVX2__ */
+
+static int sum_squared_heights(const Field *field)
+{
+    char top[16] = { };
+    __m128i lo, hi, sum;
+
+    memcpy(top, field->top, FIELD_WIDTH);
+    hi  = _mm_loadu_si128((const __m128i*)top);
+    lo  = _mm_unpacklo_epi8(hi, _mm_setzero_si128());
+    hi  = _mm_unpackhi_epi8(hi, _mm_setzero_si128());
+    sum = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+    sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+    return _mm_cvtsi128_si32(sum);
+}
+
+int evaluate_full(const Field *field, int score)
+{
+    return weigh( score, count_boundaries(field) + count_id_boundaries(field),
+                  sum_squared_heights(field) ) - shape_terms(field);
+}
+
+#else /* no SSE2 */
+
+int evaluate_full(const Field *field, int score)
+{
+    return evaluate_reference(field, score);
+}
+
+#endif /* ndef __SSE2__ */
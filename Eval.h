@@ -0,0 +1,25 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "Base.h"
+
+/* Terms of the evaluation, each subtracted from the field value with its
+   weight (except the score, which is added). */
+enum WeightIndex
+{
+    W_SCORE, W_BOUNDARIES, W_HEIGHTS, W_CLIFFS, W_HOLES, NUM_WEIGHTS
+};
+
+extern int weight[NUM_WEIGHTS];
+extern const char *weight_name[NUM_WEIGHTS];
+
+bool load_weights(const char *path);
+bool save_weights(const char *path, const int w[NUM_WEIGHTS]);
+
+int evaluate(const Field *field, int score);
+int evaluate_full(const Field *field, int score);
+int evaluate_reference(const Field *field, int score);
+bool bound_admissible(void);
+int evaluate_bound(const Field *field, int score, int lines, int tiles);
+
+#endif /* ndef EVAL_H */
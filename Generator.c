@@ -0,0 +1,223 @@
+#include "Base.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+#define MAX_LENGTH      10000000
+
+static long length = 1000;
+static int min_tiles = 2, max_tiles = PIECE_SIZE, weight[NUM_PIECES];
+
+/* Returns a random number in [0, n). */
+static int random_below(Random *state, int n)
+{
+    return (int)(next_random(state) >> 33) % n;
+}
+
+/* Derives the generator state for a game from the seed (which may be any
+   number, including zero) with a splitmix64 step. */
+static Random seed_random(Random seed, int game)
+{
+    Random z = seed + (game + 1)*0x9E3779B97F4A7C15ull;
+    z = (z ^ z >> 30)*0xBF58476D1CE4E5B9ull;
+    z = (z ^ z >> 27)*0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+/* Generates a random connected shape of 'tiles' tiles in a grid of
+   PIECE_SIZE by PIECE_SIZE, grown tile by tile from the pivot. */
+static void generate_piece(Random *state, int tiles, char grid[PIECE_SIZE][PIECE_SIZE])
+{
+    static const int dx[4] = { 1, -1, 0, 0 }, dy[4] = { 0, 0, 1, -1 };
+    int x, y, d, n, count = 1, options;
+
+    memset(grid, '0', PIECE_SIZE*PIECE_SIZE);
+    grid[PIECE_SIZE/2][PIECE_SIZE/2] = 'X';
+    while(count < tiles)
+    {
+        /* Pick one of the free tiles next to the shape, counting each as
+           often as it has neighbours in the shape */
+        options = 0;
+        for(y = 0; y < PIECE_SIZE; ++y)
+            for(x = 0; x < PIECE_SIZE; ++x)
+                for(d = 0; d < 4; ++d)
+                    if( grid[y][x] != '0' &&
+                        x + dx[d] >= 0 && x + dx[d] < PIECE_SIZE &&
+                        y + dy[d] >= 0 && y + dy[d] < PIECE_SIZE &&
+                        grid[y + dy[d]][x + dx[d]] == '0' )
+                        ++options;
+        n = random_below(state, options);
+        for(y = 0; y < PIECE_SIZE; ++y)
+            for(x = 0; x < PIECE_SIZE; ++x)
+                for(d = 0; d < 4; ++d)
+                    if( grid[y][x] != '0' &&
+                        x + dx[d] >= 0 && x + dx[d] < PIECE_SIZE &&
+                        y + dy[d] >= 0 && y + dy[d] < PIECE_SIZE &&
+                        grid[y + dy[d]][x + dx[d]] == '0' && n-- == 0 )
+                        grid[y + dy[d]][x + dx[d]] = '1';
+        ++count;
+    }
+}
+
+static bool write_piece(const char *path, char grid[PIECE_SIZE][PIECE_SIZE])
+{
+    FILE *fp = fopen(path, "wt");
+    int y;
+
+    if(!fp)
+        return false;
+    for(y = 0; y < PIECE_SIZE; ++y)
+        fprintf(fp, "%.*s\n", PIECE_SIZE, grid[y]);
+    return fclose(fp) == 0;
+}
+
+static bool write_sequence(const char *path, Random *state)
+{
+    char buf[65536];
+    FILE *fp = fopen(path, "wt");
+    int total = 0, n, m;
+    long pos;
+
+    if(!fp)
+        return false;
+    for(n = 0; n < NUM_PIECES; ++n)
+        total += weight[n];
+    for(pos = 0; pos < length; ++pos)
+    {
+        m = random_below(state, total);
+        for(n = 0; m >= weight[n]; ++n)
+            m -= weight[n];
+        buf[pos%sizeof(buf)] = '0' + n;
+        if(pos%sizeof(buf) == sizeof(buf) - 1 &&
+           fwrite(buf, 1, sizeof(buf), fp) != sizeof(buf))
+            break;
+    }
+    if(pos == length)
+        fwrite(buf, 1, pos%sizeof(buf), fp);
+    return fclose(fp) == 0 && pos == length;
+}
+
+/* Writes a game directory: the pieces 0.txt through 9.txt and game.txt. */
+static bool generate_game(const char *dir, Random state)
+{
+    char path[1024], grid[PIECE_SIZE][PIECE_SIZE];
+    int n;
+
+    if(mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Unable to create directory \"%s\"!\n", dir);
+        return false;
+    }
+    for(n = 0; n < NUM_PIECES; ++n)
+    {
+        generate_piece( &state, min_tiles +
+                        random_below(&state, max_tiles - min_tiles + 1), grid );
+        sprintf(path, "%s/%d.txt", dir, n);
+        if(!write_piece(path, grid))
+        {
+            fprintf(stderr, "Unable to write piece to file \"%s\"!\n", path);
+            return false;
+        }
+    }
+    sprintf(path, "%s/game.txt", dir);
+    if(!write_sequence(path, &state))
+    {
+        fprintf(stderr, "Unable to write game data to file \"%s\"!\n", path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = NULL;
+    char path[1024];
+    Random seed = 1;
+    int games = 0, n;
+
+    for(n = 0; n < NUM_PIECES; ++n)
+        weight[n] = 1;
+
+    for(n = 1; n < argc; ++n)
+    {
+        if(strcmp(argv[n], "-s") == 0 && n + 1 < argc)
+            seed = strtoul(argv[++n], NULL, 0);
+        else
+        if(strcmp(argv[n], "-n") == 0 && n + 1 < argc)
+            length = atol(argv[++n]);
+        else
+        if(strcmp(argv[n], "-g") == 0 && n + 1 < argc)
+            games = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-c") == 0 && n + 1 < argc)
+        {
+            if(sscanf(argv[++n], "%d-%d", &min_tiles, &max_tiles) == 1)
+                max_tiles = min_tiles;
+        }
+        else
+        if(strcmp(argv[n], "-w") == 0 && n + 1 < argc)
+        {
+            const char *p = argv[++n];
+            int m, total = 0;
+            for(m = 0; m < NUM_PIECES; ++m)
+            {
+                weight[m] = *p ? strtol(p, (char**)&p, 10) : 0;
+                if(weight[m] < 0 || (*p && *p++ != ','))
+                    break;
+                total += weight[m];
+            }
+            if(m < NUM_PIECES || *p || total <= 0)
+            {
+                fprintf(stderr, "Invalid piece weights \"%s\"!\n", argv[n]);
+                return 1;
+            }
+        }
+        else
+        if(argv[n][0] == '-')
+        {
+            dir = NULL;     /* unknown option: print the usage */
+            break;
+        }
+        else
+            dir = argv[n];
+    }
+    if(!dir)
+    {
+        fprintf( stderr, "Usage: %s [-s seed] [-n length] [-c tiles|min-max] "
+                         "[-w w0,w1,...,w9] [-g games] <directory>\n", argv[0] );
+        return 1;
+    }
+    if(length < 1 || length > MAX_LENGTH)
+    {
+        fprintf(stderr, "Game length must be between 1 and %d!\n", MAX_LENGTH);
+        return 1;
+    }
+    if(min_tiles < 1 || max_tiles < min_tiles || max_tiles > PIECE_SIZE*PIECE_SIZE)
+    {
+        fprintf( stderr, "Piece sizes must be between 1 and %d tiles!\n",
+                 PIECE_SIZE*PIECE_SIZE );
+        return 1;
+    }
+    if(strlen(dir) > sizeof(path) - 32)
+    {
+        fprintf(stderr, "Directory name too long!\n");
+        return 1;
+    }
+
+    /* Without -g, write a single game to the directory itself */
+    if(games <= 0)
+        return generate_game(dir, seed_random(seed, 0)) ? 0 : 1;
+
+    if(mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Unable to create directory \"%s\"!\n", dir);
+        return 1;
+    }
+    for(n = 0; n < games; ++n)
+    {
+        sprintf(path, "%s/%04d", dir, n);
+        if(!generate_game(path, seed_random(seed, n)))
+            return 1;
+    }
+    return 0;
+}
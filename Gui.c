@@ -1,31 +1,96 @@
 #include "Gui.h"
+#include <limits.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
-#include <sys/time.h>
 void usleep(unsigned long usec);
 
 #define SCALE           10
 #define STATS_WIDTH    175
+#define WINDOW_WIDTH    (STATS_WIDTH + 21*SCALE)
+#define WINDOW_HEIGHT   (45*SCALE)
+#define FRAME_ROWS      (FIELD_HEIGHT + PIECE_SIZE)     /* field and the area above it */
+#define MAX_BLOCKS      (FIELD_WIDTH*FRAME_ROWS + 6*45)
+#define RING_SIZE        8      /* snapshots queued for the render thread */
+#define POLL_DELAY   10000      /* microseconds to sleep when there is nothing to do */
+#define KEY_QUEUE_SIZE  16
+#define MAX_UPCOMING    (WINDOW_HEIGHT/(2*SCALE))   /* pieces that fit beside the field */
+
+/* What the GUI shows: a copy of the state passed to gui_update(). */
+typedef struct Snapshot
+{
+    Stats   stats;
+    Tiles   tiles;
+    char    top[FIELD_WIDTH];
+    Form    *form;
+    int     xpos;
+    int     upcoming;               /* number of ids in 'next' */
+    char    next[MAX_UPCOMING];     /* ids of the pieces after stats.pos */
+} Snapshot;
+
+/* A block to be drawn at a window position. */
+typedef struct Block
+{
+    short   x, y;
+    int     color;
+} Block;
 
+/* All X11 calls are made by the render thread. The thread calling
+   gui_update() only adds snapshots to a ring buffer; it drops them if the
+   ring is full, so it never waits for the display. */
 struct GUI
 {
     Game    *game;
-    Stats   *stats;
+
+    /* The state passed to the last gui_update(), shown by gui_wait() */
     Field   *field;
-    Form    *form;
-    int     xpos;
+    Tiles   *tiles;
+    Stats   *stats;
+
+    /* Snapshots are only added by the updating thread, and only removed by
+       the render thread, so the ring needs no lock. */
+    Snapshot ring[RING_SIZE];
+    volatile unsigned head, tail;
 
+    /* Used by the render thread only */
+    Snapshot view, pending;
+    bool    have_pending;
     Display *display;
     Window  window;
     GC      gc;
 
     XColor block_color[22][3];
 
+    /* Frames are drawn into 'buffer', which keeps the previous frame, so
+       only the cells that changed are drawn again. The blocks to be drawn
+       are collected first and then drawn by color. */
+    Pixmap  buffer;
+    char    drawn[FIELD_WIDTH][FRAME_ROWS];     /* colors in the buffer */
+    int     drawn_values[12];
+    bool    drawn_once, exposed;
+    Block   block[MAX_BLOCKS];
+    int     blocks;
+    unsigned colors;                            /* mask of colors in 'block' */
+    XRectangle fill[MAX_BLOCKS];
+    XSegment lit[2*MAX_BLOCKS], shaded[2*MAX_BLOCKS];
+    struct { int x1, y1, x2, y2; } dirty;       /* area to copy to the window */
+
     long long last_update;
     int     last_game_pos;
     int     update_delay;
     int     rotation;
-    bool    discard, drop, abort;
+    bool    discard, drop;
+
+    /* Requests to the render thread, protected by 'lock' */
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    Piece           *manual;        /* piece to be moved manually */
+    Move            move;
+    bool            moved;
+    GuiKey          key[KEY_QUEUE_SIZE];   /* keys for gui_read_key() */
+    int             key_head, key_tail;
+    volatile bool   abort, closing;
 };
 
 int block_color[22][3] = {
@@ -34,13 +99,7 @@ int block_color[22][3] = {
     { 205, 135, 222 }, {  42, 212, 255 }, { 204, 255,   0 }, {  64,  64,  64 } };
 const double block_shade[3] = { 0.7, 0.9, 1.0 };
 
-static long long utime()
-{
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return 1000000ll*tv.tv_sec + tv.tv_usec;
-
-}
+static void *render_main(void *arg);
 
 GUI *gui_create(Game *game, const char *window_title)
 {
@@ -63,12 +122,12 @@ GUI *gui_create(Game *game, const char *window_title)
 
     /* Create GUI structure */
     gui = malloc(sizeof(*gui));
-    memset(gui, 0, sizeof(*gui));
     if(!gui)
     {
-        XCloseDisplay(gui->display);
+        XCloseDisplay(display);
         return NULL;
     }
+    memset(gui, 0, sizeof(*gui));
     gui->game           = game;
     gui->display        = display;
     gui->update_delay   = 6;
@@ -82,8 +141,8 @@ GUI *gui_create(Game *game, const char *window_title)
 
         screen_width  = DisplayWidth(display, 0);
         screen_height = DisplayWidth(display, 0);
-        width  = STATS_WIDTH + 21*SCALE;
-        height = 45*SCALE;
+        width  = WINDOW_WIDTH;
+        height = WINDOW_HEIGHT;
         gui->window = XCreateSimpleWindow( display, RootWindow(display, 0),
             (screen_width + width)/2, (screen_height + height)/2, width, height,
             2, BlackPixel(display, 0), BlackPixel(display, 0) );
@@ -107,6 +166,11 @@ GUI *gui_create(Game *game, const char *window_title)
         gui->gc = XCreateGC(display, gui->window, 0, 0);
     }
 
+    /* Create the buffer frames are drawn into */
+    gui->buffer = XCreatePixmap( display, gui->window, WINDOW_WIDTH,
+                                 WINDOW_HEIGHT, DefaultDepth(display, 0) );
+    gui->dirty.x1 = gui->dirty.y1 = INT_MAX;
+
     /* Allocate colors */
     {
         Visual* default_visual = DefaultVisual(display, DefaultScreen(display));
@@ -133,29 +197,87 @@ GUI *gui_create(Game *game, const char *window_title)
     }
     XSync(display, false);
 
+    /* From here on, the display is only used by the render thread */
+    pthread_mutex_init(&gui->lock, NULL);
+    pthread_cond_init(&gui->cond, NULL);
+    if(pthread_create(&gui->thread, NULL, render_main, gui) != 0)
+    {
+        pthread_mutex_destroy(&gui->lock);
+        pthread_cond_destroy(&gui->cond);
+        XFreePixmap(gui->display, gui->buffer);
+        XFreeGC(gui->display, gui->gc);
+        XCloseDisplay(gui->display);
+        free(gui);
+        return NULL;
+    }
+
     return gui;
 }
 
 void gui_destroy(GUI *gui)
 {
+    gui->closing = true;
+    pthread_join(gui->thread, NULL);
+    pthread_mutex_destroy(&gui->lock);
+    pthread_cond_destroy(&gui->cond);
+    XFreePixmap(gui->display, gui->buffer);
     XFreeGC(gui->display, gui->gc);
     XCloseDisplay(gui->display);
     free(gui);
 }
 
-void gui_process(GUI *gui, bool blocking)
+/* Queues a key pressed for gui_read_key(), unless it has no meaning there
+   or the queue is full. */
+static void queue_key(GUI *gui, KeySym sym)
+{
+    GuiKey key;
+
+    switch(sym)
+    {
+    case XK_Left:       key = KEY_LEFT;         break;
+    case XK_Right:      key = KEY_RIGHT;        break;
+    case XK_Up:         key = KEY_UP;           break;
+    case XK_Down:       key = KEY_DOWN;         break;
+    case XK_Page_Up:    key = KEY_PAGE_UP;      break;
+    case XK_Page_Down:  key = KEY_PAGE_DOWN;    break;
+    case XK_Home:       key = KEY_HOME;         break;
+    case XK_End:        key = KEY_END;          break;
+    case XK_d:          key = KEY_DISCARD;      break;
+    default:            return;
+    }
+
+    pthread_mutex_lock(&gui->lock);
+    if(gui->key_tail - gui->key_head < KEY_QUEUE_SIZE)
+    {
+        gui->key[gui->key_tail++%KEY_QUEUE_SIZE] = key;
+        pthread_cond_broadcast(&gui->cond);
+    }
+    pthread_mutex_unlock(&gui->lock);
+}
+
+/* Handles pending X events. The keys that move a piece are only applied
+   while a piece is moved manually, as otherwise they would shift the piece
+   shown. Returns whether any events were handled, in which case the window
+   should be redrawn. */
+static bool gui_process(GUI *gui, bool manual)
 {
     XEvent event;
-    while( blocking ? XNextEvent(gui->display, &event), true
-                    : XCheckMaskEvent(gui->display, -1, &event) )
+    bool handled = false;
+
+    while(XCheckMaskEvent(gui->display, -1, &event))
     {
-        blocking = false;
+        handled = true;
 
         switch(event.type)
         {
+        case Expose:
+            gui->exposed = true;
+            break;
         case KeyPress:
             {
-                switch(XKeycodeToKeysym(gui->display, event.xkey.keycode, 0))
+                KeySym sym = XKeycodeToKeysym(gui->display, event.xkey.keycode, 0);
+                queue_key(gui, sym);
+                switch(sym)
                 {
                 case XK_equal:
                     if(gui->update_delay > 0)
@@ -164,57 +286,167 @@ void gui_process(GUI *gui, bool blocking)
                 case XK_minus:
                     ++(gui->update_delay);
                     break;
-                case XK_Left:
-                    --gui->xpos;
-                    break;
-                case XK_Right:
-                    ++gui->xpos;
-                    break;
-                case XK_Up:
-                    ++gui->rotation;
-                    break;
-                case XK_Down:
-                    gui->drop = true;
-                    break;
-                case XK_Delete:
-                    gui->discard = true;
-                    break;
                 case XK_Escape:
+                    pthread_mutex_lock(&gui->lock);
                     gui->abort = true;
+                    pthread_cond_broadcast(&gui->cond);
+                    pthread_mutex_unlock(&gui->lock);
                     break;
                 }
+                if(manual)
+                    switch(sym)
+                    {
+                    case XK_Left:
+                        --gui->view.xpos;
+                        break;
+                    case XK_Right:
+                        ++gui->view.xpos;
+                        break;
+                    case XK_Up:
+                        ++gui->rotation;
+                        break;
+                    case XK_Down:
+                        gui->drop = true;
+                        break;
+                    case XK_Delete:
+                        gui->discard = true;
+                        break;
+                    }
             } break;
         }
     }
+    return handled;
 }
 
-static void draw_block(GUI *gui, int x, int y, int color)
+/* Adds a block at window position (x, y) to the blocks to be drawn. */
+static void add_block(GUI *gui, int x, int y, int color)
 {
-    XPoint pts[6] = {
-        { x + SCALE - 1, y }, { x, y }, { x, y + SCALE - 1 },
-        { x + SCALE - 1, y }, { x + SCALE - 1, y + SCALE - 1 }, { x, y + SCALE - 1 } };
+    Block *block = &gui->block[gui->blocks++];
+
+    block->x     = x;
+    block->y     = y;
+    block->color = color;
+    gui->colors |= 1 << color;
+    if(x < gui->dirty.x1) gui->dirty.x1 = x;
+    if(y < gui->dirty.y1) gui->dirty.y1 = y;
+    if(x + SCALE > gui->dirty.x2) gui->dirty.x2 = x + SCALE;
+    if(y + SCALE > gui->dirty.y2) gui->dirty.y2 = y + SCALE;
+}
 
-    XSetForeground(gui->display, gui->gc, gui->block_color[color][1].pixel);
-    XFillRectangle(gui->display, gui->window, gui->gc, x + 1, y + 1, SCALE - 2, SCALE - 2);
+/* Draws the blocks added since the last call into the buffer, with three
+   requests per color used: the insides, the lit edges and the shaded
+   edges. */
+static void draw_blocks(GUI *gui)
+{
+    XRectangle *fill = gui->fill;
+    XSegment *lit = gui->lit, *shaded = gui->shaded;
+    int color, n, m;
 
-    XSetForeground(gui->display, gui->gc, gui->block_color[color][2].pixel);
-    XDrawLines(gui->display, gui->window, gui->gc, pts, 3, CoordModeOrigin);
+    for(color = 0; color < 22; ++color)
+    {
+        if(!(gui->colors >> color & 1))
+            continue;
+        for(n = m = 0; n < gui->blocks; ++n)
+        {
+            const Block *b = &gui->block[n];
+            short x1 = b->x, y1 = b->y, x2 = b->x + SCALE - 1, y2 = b->y + SCALE - 1;
+            XSegment top = { x2, y1, x1, y1 }, left = { x1, y1, x1, y2 },
+                     right = { x2, y1, x2, y2 }, bottom = { x2, y2, x1, y2 };
+            XRectangle inside = { 0, 0, SCALE - 2, SCALE - 2 };
+
+            if(b->color != color)
+                continue;
+            inside.x = x1 + 1;
+            inside.y = y1 + 1;
+            fill[m] = inside;
+            lit[2*m] = top;
+            lit[2*m + 1] = left;
+            shaded[2*m] = right;
+            shaded[2*m + 1] = bottom;
+            ++m;
+        }
+        XSetForeground(gui->display, gui->gc, gui->block_color[color][1].pixel);
+        XFillRectangles(gui->display, gui->buffer, gui->gc, fill, m);
+        XSetForeground(gui->display, gui->gc, gui->block_color[color][2].pixel);
+        XDrawSegments(gui->display, gui->buffer, gui->gc, lit, 2*m);
+        XSetForeground(gui->display, gui->gc, gui->block_color[color][0].pixel);
+        XDrawSegments(gui->display, gui->buffer, gui->gc, shaded, 2*m);
+    }
+    gui->blocks = 0;
+    gui->colors = 0;
+}
+
+/* Sets the color of a cell of the field or the area above it, adding a
+   block if it differs from the one drawn before. */
+static void set_cell(GUI *gui, int x, int row, int color)
+{
+    if(gui->drawn[x][row] == color)
+        return;
+    gui->drawn[x][row] = color;
+    add_block(gui, STATS_WIDTH + SCALE*x, SCALE*row, color);
+}
 
-    XSetForeground(gui->display, gui->gc, gui->block_color[color][0].pixel);
-    XDrawLines(gui->display, gui->window, gui->gc, pts + 3, 3, CoordModeOrigin);
+/* Clears a rectangle of the buffer, marking it as dirty. */
+static void clear_area(GUI *gui, int x, int y, int width, int height)
+{
+    XSetForeground(gui->display, gui->gc, BlackPixel(gui->display, 0));
+    XFillRectangle(gui->display, gui->buffer, gui->gc, x, y, width, height);
+    if(x < gui->dirty.x1) gui->dirty.x1 = x;
+    if(y < gui->dirty.y1) gui->dirty.y1 = y;
+    if(x + width > gui->dirty.x2) gui->dirty.x2 = x + width;
+    if(y + height > gui->dirty.y2) gui->dirty.y2 = y + height;
 }
 
-void gui_redraw(GUI *gui)
+/* Draws the current snapshot into the buffer, redrawing only what changed
+   since the last frame, and copies the changed area to the window. */
+static void gui_redraw(GUI *gui)
 {
-    int x, y, ypos = 0;
+    static const char * const headings[12] = {
+        "Source revision:",
+        "Instruction:",
+        "Pieces:",
+        "   Discarded:",
+        "   Dropped:",
+        "Lines cleared:",
+        "   1 line: ",
+        "   2 lines: ",
+        "   3 lines:",
+        "   4 lines:",
+        "   5 lines:",
+        "Score:" };
+    const Snapshot *view = &gui->view;
+    const Stats *stats = &view->stats;
+    const Form *form = view->form;
+    const int valuesx = (STATS_WIDTH*2)/3 - 10;
+    const bool full = !gui->drawn_once;
+    int x, y, n, ypos = 0;
+
+    if(gui->exposed)
+    {
+        gui->dirty.x1 = gui->dirty.y1 = 0;
+        gui->dirty.x2 = WINDOW_WIDTH;
+        gui->dirty.y2 = WINDOW_HEIGHT;
+        gui->exposed  = false;
+    }
+
+    if(full)
+    {
+        clear_area(gui, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+        memset(gui->drawn, -1, sizeof(gui->drawn));
+        XSetForeground(gui->display, gui->gc, WhitePixel(gui->display, 0));
+        for(n = 0; n < 12; ++n)
+            XDrawString( gui->display, gui->buffer, gui->gc,
+                10, 15*(n + 1), headings[n], strlen(headings[n]) );
+        gui->drawn_once = true;
+    }
 
-    if(gui->field && gui->form)
+    if(form)
     {
-        for(x = gui->xpos; x < gui->xpos + gui->form->width; ++x)
+        for(x = view->xpos; x < view->xpos + form->width; ++x)
         {
-            if(gui->form->bottom[x - gui->xpos] >= 0)
+            if(form->bottom[x - view->xpos] >= 0)
             {
-                y = gui->field->top[x] - gui->form->bottom[x - gui->xpos];
+                y = view->top[x] - form->bottom[x - view->xpos];
                 if(y > ypos)
                     ypos = y;
             }
@@ -224,184 +456,301 @@ void gui_redraw(GUI *gui)
     for(x = 0; x < FIELD_WIDTH; ++x)
         for(y = 0; y < FIELD_HEIGHT; ++y)
         {
-            int sx = STATS_WIDTH + SCALE*x,
-                sy = SCALE*(FIELD_HEIGHT + PIECE_SIZE - 1 - y);
-            if( gui->form && x >= gui->xpos && x < gui->xpos + gui->form->width
-                          && y >= ypos + gui->form->top[x - gui->xpos]
-                          && gui->form->bottom[x - gui->xpos] >= 0 )
+            int row = FIELD_HEIGHT + PIECE_SIZE - 1 - y;
+            if( form && x >= view->xpos && x < view->xpos + form->width
+                     && y >= ypos + form->top[x - view->xpos]
+                     && form->bottom[x - view->xpos] >= 0 )
             {
-                draw_block(gui, sx, sy, 11 + gui->form->id);
+                set_cell(gui, x, row, 11 + form->id);
             }
             else
-            if( gui->form && x >= gui->xpos && x < gui->xpos + gui->form->width
-                          && y >= ypos && y < ypos + gui->form->height
-                          && gui->form->tile[x - gui->xpos][y - ypos] )
+            if( form && x >= view->xpos && x < view->xpos + form->width
+                     && y >= ypos && y < ypos + form->height
+                     && form->tile[x - view->xpos][y - ypos] )
             {
-                draw_block(gui, sx, sy, gui->form->id);
+                set_cell(gui, x, row, form->id);
             }
             else
             {
-                draw_block( gui, sx, sy,
-                            gui->field ? gui->field->tile[x][y] : 0 );
+                set_cell(gui, x, row, view->tiles.tile[x][y]);
             }
         }
     for(x = 0; x < FIELD_WIDTH; ++x)
         for(y = 0; y < PIECE_SIZE; ++y)
         {
-            int sx = STATS_WIDTH + SCALE*x,
-                sy = SCALE*(PIECE_SIZE - 1 - y);
-            if( gui->form && x >= gui->xpos && x < gui->xpos + gui->form->width
-                          && y < gui->form->bottom[x - gui->xpos] )
+            int row = PIECE_SIZE - 1 - y;
+            if( form && x >= view->xpos && x < view->xpos + form->width
+                     && y < form->bottom[x - view->xpos] )
             {
-                draw_block(gui, sx, sy, 11 + gui->form->id);
+                set_cell(gui, x, row, 11 + form->id);
             }
             else
-            if( gui->form && x >= gui->xpos && x < gui->xpos + gui->form->width
-                          && gui->form->tile[x - gui->xpos][y] )
+            if( form && x >= view->xpos && x < view->xpos + form->width
+                     && form->tile[x - view->xpos][y] )
             {
-                draw_block(gui, sx, sy, gui->form->id);
+                set_cell(gui, x, row, form->id);
             }
             else
             {
-                draw_block(gui, sx, sy, 11);
+                set_cell(gui, x, row, 11);
             }
         }
 
     /* Draw upcoming pieces */
-    if(!gui->stats || gui->last_game_pos != gui->stats->pos)
+    if(full || gui->last_game_pos != stats->pos)
     {
-        XSetForeground(gui->display, gui->gc, BlackPixel(gui->display, 0));
-        XFillRectangle(gui->display, gui->window, gui->gc,
-            STATS_WIDTH + 15*SCALE + 5, 0, 6*SCALE - 5, 45*SCALE );
-        gui->last_game_pos = gui->stats->pos;
-    }
+        int sy = 0;
 
-    if(gui->stats)
-    {
-        int n, sy = 0;
+        clear_area( gui, STATS_WIDTH + 15*SCALE + 5, 0,
+                    6*SCALE - 5, WINDOW_HEIGHT );
+        gui->last_game_pos = stats->pos;
 
-        for(n = gui->stats->pos + 1; n < gui->game->input_size; ++n)
+        for(n = 0; n < view->upcoming; ++n)
         {
-            Form *form = gui->game->piece[(int)gui->game->input[n]].form;
+            Form *form = gui->game->piece[(int)view->next[n]].form;
             if(form[0].height > form[1].height)
                 ++form;
-            if(sy + SCALE*(1 + form->height) > 45*SCALE)
+            if(sy + SCALE*(1 + form->height) > WINDOW_HEIGHT)
                 break;
             for(x = 0; x < form->width; ++x)
                 for(y = 0; y < form->height; ++y)
                     if(form->tile[x][y])
                     {
-                        draw_block( gui, STATS_WIDTH + (15 + x)*SCALE + (6 - form->width)*SCALE/2,
+                        add_block( gui, STATS_WIDTH + (15 + x)*SCALE + (6 - form->width)*SCALE/2,
                             sy + (form->height - y - 1)*SCALE + SCALE/2,
                             form->tile[x][y] );
                     }
             sy += (form->height + 1)*SCALE;
         }
+    }
+    draw_blocks(gui);
 
-        /* Draw stats */
-        static const char * const headings[12] = {
-            "Source revision:",
-            "Instruction:",
-            "Pieces:",
-            "   Discarded:",
-            "   Dropped:",
-            "Lines cleared:",
-            "   1 line: ",
-            "   2 lines: ",
-            "   3 lines:",
-            "   4 lines:",
-            "   5 lines:",
-            "Score:" };
+    /* Draw stats */
+    {
         const int values[12] = {
             REVISION,
-            gui->stats->instr, gui->stats->pos,
-            gui->stats->discarded, gui->stats->dropped,
-            ( gui->stats->cleared[1] + gui->stats->cleared[2] +
-              gui->stats->cleared[3] + gui->stats->cleared[4] +
-              gui->stats->cleared[5] ),
-            gui->stats->cleared[1], gui->stats->cleared[2],
-            gui->stats->cleared[3], gui->stats->cleared[4],
-            gui->stats->cleared[5],
-            gui->stats->score + 400*(5 - gui->stats->discarded) };
-        const int valuesx = (STATS_WIDTH*2)/3 - 10;
-
-        XSetForeground(gui->display, gui->gc, BlackPixel(gui->display, 0));
-        XFillRectangle(gui->display, gui->window, gui->gc,
-            valuesx, 0, STATS_WIDTH - valuesx, 15*12);
-
-        XSetForeground(gui->display, gui->gc, WhitePixel(gui->display, 0));
-        for(n = 0; n < 12; ++n)
+            stats->instr, stats->pos,
+            stats->discarded, stats->dropped,
+            ( stats->cleared[1] + stats->cleared[2] +
+              stats->cleared[3] + stats->cleared[4] +
+              stats->cleared[5] ),
+            stats->cleared[1], stats->cleared[2],
+            stats->cleared[3], stats->cleared[4],
+            stats->cleared[5],
+            final_score(stats) };
+
+        if(full || memcmp(values, gui->drawn_values, sizeof(values)) != 0)
         {
-            char buf[64];
-            XDrawString( gui->display, gui->window, gui->gc,
-                10, 15*(n + 1), headings[n], strlen(headings[n]) );
-            sprintf(buf, "%8d", values[n]);
-            XDrawString( gui->display, gui->window, gui->gc,
-                (STATS_WIDTH*2)/3 - 10, 15*(n + 1), buf, strlen(buf) );
+            clear_area(gui, valuesx, 0, STATS_WIDTH - valuesx, 15*12);
+            XSetForeground(gui->display, gui->gc, WhitePixel(gui->display, 0));
+            for(n = 0; n < 12; ++n)
+            {
+                char buf[64];
+                sprintf(buf, "%8d", values[n]);
+                XDrawString( gui->display, gui->buffer, gui->gc,
+                    valuesx, 15*(n + 1), buf, strlen(buf) );
+            }
+            memcpy(gui->drawn_values, values, sizeof(values));
         }
     }
-}
-
-void gui_update(GUI *gui, Field *field, Stats *stats, Form *form, int xpos)
-{
-    long long t, ut;
-
-    gui->field = field;
-    gui->stats = stats;
-    gui->form  = form;
-    gui->xpos  = xpos;
-
-    gui_redraw(gui);
-    gui_process(gui, false);
 
-    if(gui->update_delay)
+    /* Copy what changed to the window */
+    if(gui->dirty.x1 < gui->dirty.x2)
     {
-        t  = utime();
-        ut = gui->last_update + 50000*gui->update_delay;
-        if(ut > t)
-            usleep(ut - t);
-        gui->last_update = utime();
+        XCopyArea( gui->display, gui->buffer, gui->window, gui->gc,
+                   gui->dirty.x1, gui->dirty.y1,
+                   gui->dirty.x2 - gui->dirty.x1, gui->dirty.y2 - gui->dirty.y1,
+                   gui->dirty.x1, gui->dirty.y1 );
+        XFlush(gui->display);
     }
+    gui->dirty.x1 = gui->dirty.y1 = INT_MAX;
+    gui->dirty.x2 = gui->dirty.y2 = 0;
 }
 
-void gui_wait(GUI *gui)
+/* Takes the latest snapshot from the ring (if any) as the pending one,
+   discarding older snapshots. */
+static void take_snapshot(GUI *gui)
 {
-    while(!gui->abort)
-    {
-        gui_process(gui, true);
-        gui_redraw(gui);
-    }
+    unsigned tail = gui->tail;
+
+    if(gui->head == tail)
+        return;
+    __sync_synchronize();       /* read the snapshot after the tail */
+    gui->pending = gui->ring[(tail - 1)%RING_SIZE];
+    gui->have_pending = true;
+    __sync_synchronize();       /* and before releasing its slot */
+    gui->head = tail;
 }
 
-bool gui_manual_move(GUI *gui, Move *move)
+/* Shows the pending snapshot if the update delay has passed. */
+static bool show_snapshot(GUI *gui, bool paced)
 {
-    Piece *piece;
-    if(!(gui->field && gui->stats))
+    long long t = utime();
+
+    if(!gui->have_pending)
+        return false;
+    if(paced && t < gui->last_update + 50000*gui->update_delay)
         return false;
+    gui->view = gui->pending;
+    gui->have_pending = false;
+    gui->last_update = t;
+    return true;
+}
 
-    piece = &gui->game->piece[(int)gui->game->input[gui->stats->pos]];
-    gui->xpos      = (FIELD_WIDTH - piece->form[0].width)/2;
+/* Lets the user move the requested piece, until it is dropped or
+   discarded or the GUI is aborted. */
+static void manual_move(GUI *gui, Piece *piece)
+{
+    take_snapshot(gui);
+    show_snapshot(gui, false);
+    gui->view.xpos = (FIELD_WIDTH - piece->form[0].width)/2;
     gui->rotation  = 0;
     gui->drop = gui->discard = false;
-    while(!(gui->drop || gui->discard || gui->abort))
+    while(!(gui->drop || gui->discard || gui->abort || gui->closing))
     {
-        gui->form = &piece->form[gui->rotation];
+        gui->view.form = &piece->form[gui->rotation];
         gui_redraw(gui);
-        gui_process(gui, true);
+        while(!gui_process(gui, true) && !gui->closing)
+            usleep(POLL_DELAY);
         gui->rotation = gui->rotation%4;
-        if(gui->xpos < 0)
-            gui->xpos = 0;
-        if(gui->xpos > FIELD_WIDTH - piece->form[gui->rotation].width)
-            gui->xpos = FIELD_WIDTH - piece->form[gui->rotation].width;
+        if(gui->view.xpos < 0)
+            gui->view.xpos = 0;
+        if(gui->view.xpos > FIELD_WIDTH - piece->form[gui->rotation].width)
+            gui->view.xpos = FIELD_WIDTH - piece->form[gui->rotation].width;
     }
-    if(gui->abort)
-        return false;
+
+    pthread_mutex_lock(&gui->lock);
     if(gui->discard)
-        move->form = -1;
+        gui->move.form = -1;
     else
     {
-        move->form = gui->rotation;
-        move->xpos = gui->xpos;
+        gui->move.form = gui->rotation;
+        gui->move.xpos = gui->view.xpos;
     }
-    return true;
+    gui->moved  = gui->drop || gui->discard;
+    gui->manual = NULL;
+    pthread_cond_broadcast(&gui->cond);
+    pthread_mutex_unlock(&gui->lock);
+}
+
+static void *render_main(void *arg)
+{
+    GUI *gui = arg;
+    Piece *piece;
+    bool redraw = true;
+
+    while(!gui->closing)
+    {
+        pthread_mutex_lock(&gui->lock);
+        piece = gui->manual;
+        pthread_mutex_unlock(&gui->lock);
+        if(piece)
+        {
+            manual_move(gui, piece);
+            redraw = true;
+            continue;
+        }
+
+        take_snapshot(gui);
+        if(show_snapshot(gui, true))
+            redraw = true;
+        if(gui_process(gui, false))
+            redraw = true;
+        if(redraw)
+            gui_redraw(gui);
+        else
+            usleep(POLL_DELAY);
+        redraw = false;
+    }
+
+    return NULL;
+}
+
+void gui_update( GUI *gui, Field *field, Tiles *tiles, Stats *stats,
+                 Form *form, int xpos )
+{
+    Snapshot *s;
+
+    gui->field = field;
+    gui->tiles = tiles;
+    gui->stats = stats;
+
+    if(gui->tail - gui->head >= RING_SIZE)
+        return;
+    s = &gui->ring[gui->tail%RING_SIZE];
+    s->stats = *stats;
+    if(tiles)
+        s->tiles = *tiles;
+    else
+        memset(&s->tiles, 0, sizeof(s->tiles));
+    memcpy(s->top, field->top, sizeof(s->top));
+    s->form = form;
+    s->xpos = xpos;
+
+    /* A streamed game refills its window of ids from this thread, so the
+       render thread must only see the copies */
+    for( s->upcoming = 0; s->upcoming < MAX_UPCOMING &&
+         stats->pos + 1 + s->upcoming < gui->game->input_loaded; ++s->upcoming )
+        s->next[s->upcoming] = game_input(gui->game, stats->pos + 1 + s->upcoming);
+    __sync_synchronize();       /* publish the snapshot before the tail */
+    ++gui->tail;
+}
+
+void gui_wait(GUI *gui)
+{
+    /* Show the final state, waiting for room in the ring if necessary */
+    if(gui->field && gui->stats)
+    {
+        while(gui->tail - gui->head >= RING_SIZE && !gui->abort)
+            usleep(POLL_DELAY);
+        gui_update(gui, gui->field, gui->tiles, gui->stats, NULL, 0);
+    }
+
+    pthread_mutex_lock(&gui->lock);
+    while(!gui->abort)
+        pthread_cond_wait(&gui->cond, &gui->lock);
+    pthread_mutex_unlock(&gui->lock);
+}
+
+bool gui_manual_move(GUI *gui, Move *move)
+{
+    bool moved;
+
+    if(!(gui->field && gui->stats))
+        return false;
+
+    pthread_mutex_lock(&gui->lock);
+    gui->manual = &gui->game->piece[game_input(gui->game, gui->stats->pos)];
+    gui->moved  = false;
+    while(gui->manual && !gui->abort)
+        pthread_cond_wait(&gui->cond, &gui->lock);
+    moved = gui->moved;
+    if(moved)
+        *move = gui->move;
+    gui->manual = NULL;
+    pthread_mutex_unlock(&gui->lock);
+
+    return moved;
+}
+
+/* Waits for a key to be pressed. Returns KEY_ESCAPE once the GUI has been
+   aborted. */
+GuiKey gui_read_key(GUI *gui)
+{
+    GuiKey key = KEY_ESCAPE;
+
+    pthread_mutex_lock(&gui->lock);
+    while(gui->key_head == gui->key_tail && !gui->abort)
+        pthread_cond_wait(&gui->cond, &gui->lock);
+    if(gui->key_head != gui->key_tail)
+        key = gui->key[gui->key_head++%KEY_QUEUE_SIZE];
+    pthread_mutex_unlock(&gui->lock);
+
+    return key;
+}
+
+/* Sets the minimum time between frames, in units of 50 ms. */
+void gui_set_update_delay(GUI *gui, int delay)
+{
+    gui->update_delay = delay;
 }
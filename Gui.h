@@ -5,11 +5,20 @@
 
 typedef struct GUI GUI;
 
+/* Keys reported by gui_read_key() */
+typedef enum GuiKey
+{
+    KEY_NONE, KEY_ESCAPE, KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN,
+    KEY_PAGE_UP, KEY_PAGE_DOWN, KEY_HOME, KEY_END, KEY_DISCARD
+} GuiKey;
+
 GUI *gui_create(Game *game, const char *window_name);
 void gui_destroy(GUI *gui);
-void gui_update(GUI *gui, Field *field, Stats *stats, Form *form, int xpos);
-void gui_redraw(GUI *gui);
+void gui_update( GUI *gui, Field *field, Tiles *tiles, Stats *stats,
+                 Form *form, int xpos );
 bool gui_manual_move(GUI *gui, Move *move);
+GuiKey gui_read_key(GUI *gui);
+void gui_set_update_delay(GUI *gui, int delay);
 void gui_wait(GUI *gui);
 
 #endif /* ndef GUI_H */
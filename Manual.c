@@ -4,22 +4,25 @@
 bool process(Game *game, FILE *input, GUI *gui)
 {
     Field field = { };
+    Tiles tiles = { };
     Stats stats = { };
+    Output output;
     Move move;
 
+    open_output(&output, STDOUT_FILENO, false);
     while(stats.pos < game->input_size)
     {
         Piece *piece;
 
-        gui_update(gui, &field, &stats, NULL, 0);
+        gui_update(gui, &field, &tiles, &stats, NULL, 0);
         if(!gui_manual_move(gui, &move))
             return false;
 
-        piece = &game->piece[(int)game->input[stats.pos]];
+        piece = &game->piece[game_input(game, stats.pos)];
 
         if(move.form < 0)
         {
-            if(stats.discarded >= 5)
+            if(stats.discarded >= MAX_DISCARDS)
             {
                 fprintf(stderr, "No discard available at piece %d!\n", stats.pos);
                 break;
@@ -36,7 +39,8 @@ bool process(Game *game, FILE *input, GUI *gui)
                 break;
             }
 
-            if(!update_field(&field, &piece->form[move.form], move.xpos, &stats))
+            if(!update_field( &field, &tiles, &piece->form[move.form],
+                              move.xpos, &stats ))
             {
                 fprintf( stderr, "Piece does not fit with translation %d "
                     "and rotation %d at piece %d!\n",
@@ -45,8 +49,8 @@ bool process(Game *game, FILE *input, GUI *gui)
             }
         }
 
-        print_move(stdout, game, move, &stats);
-        fflush(stdout);
+        write_move(&output, game, move, &stats);
+        flush_output(&output);
 
         ++stats.pos;
     }
@@ -0,0 +1,400 @@
+#define _POSIX_C_SOURCE 199309L     /* for clock_gettime() */
+#include "Base.h"
+#include "Eval.h"
+#include "Search.h"
+#include <time.h>
+
+#define MAX_SAMPLES         4096    /* fields captured from the game */
+#define SEARCH_SAMPLES        64    /* of which the search is timed on */
+#define WARMUP                 3    /* untimed runs before each kernel */
+#define TRIALS                31
+#define SEARCH_DEPTH           3
+#define RANDOM_FIELDS    1000000    /* fields for the differential check */
+#define SEARCH_CHECKS       1000    /* random fields per pruned search check */
+
+/* A field reached while playing the game, with the position of the piece
+   to be placed on it next. */
+typedef struct Sample
+{
+    Field field;
+    int pos;
+} Sample;
+
+static const char *dir = ".";
+static Game *game;
+static Sample sample[MAX_SAMPLES];
+static int samples, trials = TRIALS, max_depth = SEARCH_DEPTH, depth;
+static long long checksum;  /* results of the kernels, so none are elided */
+
+static long long nanotime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/* Plays the game at search depth 1, recording the fields reached. */
+static void capture_samples(void)
+{
+    Searcher searcher = { };
+    Field field = { };
+    Stats stats = { };
+    Move move;
+
+    searcher.game = game;
+    for( stats.pos = 0; stats.pos < game->input_size && samples < MAX_SAMPLES;
+         ++stats.pos )
+    {
+        sample[samples].field = field;
+        sample[samples].pos   = stats.pos;
+        ++samples;
+        if(search(&searcher, &field, stats.pos, 0, 1, &move) <= -INF/2)
+            break;
+        update_field( &field, NULL, &game->piece[game_input(game, stats.pos)].
+                      form[move.form], move.xpos, &stats );
+    }
+}
+
+/* Kernels, each running one batch of operations and returning its size. */
+
+/* Copies the field before each placement, the alternative to taking the
+   placements back that "place+unplace" measures. */
+static long long run_place(void)
+{
+    long long ops = 0;
+    int n, m;
+
+    for(n = 0; n < samples; ++n)
+    {
+        const Piece *piece = &game->piece[game_input(game, sample[n].pos)];
+
+        for(m = 0; m < piece->moves; ++m, ++ops)
+        {
+            Field field = sample[n].field;
+
+            checksum += place( &field, &piece->form[piece->move[m].form],
+                               piece->move[m].xpos );
+            checksum += field.hash;
+        }
+    }
+    return ops;
+}
+
+static long long run_place_reference(void)
+{
+    long long ops = 0;
+    int n, m;
+
+    for(n = 0; n < samples; ++n)
+    {
+        const Piece *piece = &game->piece[game_input(game, sample[n].pos)];
+
+        for(m = 0; m < piece->moves; ++m, ++ops)
+        {
+            Field field = sample[n].field;
+
+            checksum += place_reference( &field, &piece->form[piece->move[m].form],
+                                         piece->move[m].xpos );
+            checksum += field.hash;
+        }
+    }
+    return ops;
+}
+
+static long long run_place_unplace(void)
+{
+    long long ops = 0;
+    Undo undo;
+    int n, m;
+
+    for(n = 0; n < samples; ++n)
+    {
+        const Piece *piece = &game->piece[game_input(game, sample[n].pos)];
+
+        for(m = 0; m < piece->moves; ++m, ++ops)
+        {
+            if(place_reversibly( &sample[n].field, &piece->form[piece->move[m].form],
+                                 piece->move[m].xpos, &undo ) >= 0)
+            {
+                checksum += sample[n].field.hash;
+                unplace(&sample[n].field, &undo);
+            }
+        }
+    }
+    return ops;
+}
+
+static long long run_evaluate(void)
+{
+    int n;
+
+    for(n = 0; n < samples; ++n)
+        checksum += evaluate(&sample[n].field, n);
+    return samples;
+}
+
+static long long run_evaluate_full(void)
+{
+    int n;
+
+    for(n = 0; n < samples; ++n)
+        checksum += evaluate_full(&sample[n].field, n);
+    return samples;
+}
+
+static long long run_evaluate_reference(void)
+{
+    int n;
+
+    for(n = 0; n < samples; ++n)
+        checksum += evaluate_reference(&sample[n].field, n);
+    return samples;
+}
+
+/* Times root searches at the current 'depth', counting nodes as
+   operations. */
+static long long run_search(void)
+{
+    Searcher searcher = { };
+    Move move;
+    int n;
+
+    searcher.game = game;
+    for(n = 0; n < samples; n += (samples + SEARCH_SAMPLES - 1)/SEARCH_SAMPLES)
+        checksum += search(&searcher, &sample[n].field, sample[n].pos, 0, depth, &move);
+    return searcher.nodes;
+}
+
+static long long run_load_game(void)
+{
+    Game *g = load_game(dir);
+
+    if(!g)
+        return 0;
+    checksum += g->input_size;
+    free(g);
+    return 1;
+}
+
+static long long run_load_piece(void)
+{
+    static Piece piece;
+    char path[1024];
+
+    sprintf(path, "%s/0.txt", dir);
+    if(!load_piece(&piece, 1, path))
+        return 0;
+    checksum += piece.forms;
+    return 1;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Runs 'kernel' WARMUP times and then 'trials' times, and prints the
+   median and 99th percentile of the time per operation over the trials. */
+static bool measure(const char *name, long long (*kernel)(void))
+{
+    double *time;
+    long long ops = 0, t;
+    int n;
+
+    time = malloc(trials*sizeof(*time));
+    if(!time)
+        return false;
+    for(n = 0; n < WARMUP; ++n)
+        kernel();
+    for(n = 0; n < trials; ++n)
+    {
+        t = nanotime();
+        ops = kernel();
+        t = nanotime() - t;
+        if(ops <= 0)
+        {
+            fprintf(stderr, "Kernel %s failed!\n", name);
+            free(time);
+            return false;
+        }
+        time[n] = (double)t/ops;
+    }
+    qsort(time, trials, sizeof(*time), compare_times);
+    printf( "%-20s %10lld %12.1f %12.1f\n", name, ops,
+            time[trials/2], time[(99*trials + 99)/100 - 1] );
+    free(time);
+    return true;
+}
+
+static bool same_field(const Field *a, const Field *b)
+{
+    return a->hash == b->hash && a->boundaries == b->boundaries &&
+           a->heights == b->heights &&
+           memcmp(a->row, b->row, sizeof(a->row)) == 0 &&
+           memcmp(a->id, b->id, sizeof(a->id)) == 0 &&
+           memcmp(a->top, b->top, sizeof(a->top)) == 0;
+}
+
+static bool mismatch(const char *what, const Field *field, long long n)
+{
+    fprintf(stderr, "Mismatch in %s on random field %lld:\n", what, n);
+    print_field(stderr, field);
+    return false;
+}
+
+/* Returns whether searching a field with pruning finds the same value and
+   move as searching it exhaustively. */
+static bool same_search(const Field *field, int pos)
+{
+    Searcher pruned = { }, exhaustive = { };
+    Move a, b;
+    int val;
+
+    pruned.game = exhaustive.game = game;
+    exhaustive.exhaustive = true;
+    val = search(&pruned, field, pos, 0, max_depth, &a);
+    if(val != search(&exhaustive, field, pos, 0, max_depth, &b))
+        return false;
+    return val <= -INF/2 || (a.form == b.form && a.xpos == b.xpos);
+}
+
+/* Compares place(), place_reversibly() and unplace() against
+   place_reference(), and evaluate() and evaluate_full() against
+   evaluate_reference(), on 'count' random fields, checks that
+   evaluate_bound() bounds the evaluation after each placement, and that
+   search() prunes without changing its result on every SEARCH_CHECKS-th
+   field. The fields are built by dropping random pieces of the game at
+   random positions, starting over whenever a piece does not fit. */
+static bool check_kernels(long long count, Random seed)
+{
+    Field field = { }, fast, reversible, reference;
+    Undo undo;
+    long long n;
+    int lines, tiles, m;
+
+    for(n = 0; n < count; ++n)
+    {
+        const Piece *piece = &game->piece[next_random(&seed) % NUM_PIECES];
+        Move move = piece->move[next_random(&seed) % piece->moves];
+        const Form *form = &piece->form[move.form];
+
+        fast = reversible = reference = field;
+        lines = place_reference(&reference, form, move.xpos);
+        if( place(&fast, form, move.xpos) != lines ||
+            (lines >= 0 && !same_field(&fast, &reference)) )
+            return mismatch("place", &field, n);
+        if( place_reversibly(&reversible, form, move.xpos, &undo) != lines ||
+            (lines >= 0 && !same_field(&reversible, &reference)) )
+            return mismatch("place_reversibly", &field, n);
+        if(lines < 0)
+        {
+            memset(&field, 0, sizeof(field));
+            continue;
+        }
+        unplace(&reversible, &undo);
+        if(!same_field(&reversible, &field))
+            return mismatch("unplace", &field, n);
+
+        for(tiles = m = 0; m < form->height; ++m)
+            tiles += count_bits(form->mask[m]);
+        if( bound_admissible() &&
+            evaluate(&reference, lines_score[lines]) >
+            evaluate_bound(&field, lines_score[lines], lines, tiles) )
+            return mismatch("evaluate_bound", &field, n);
+        if( n % SEARCH_CHECKS == 0 &&
+            !same_search(&field, n/SEARCH_CHECKS % game->input_size) )
+            return mismatch("search", &field, n);
+
+        field = reference;
+        if(field.hash != field_hash(&field))
+            return mismatch("field_hash", &field, n);
+        if( evaluate(&field, lines) != evaluate_reference(&field, lines) ||
+            evaluate_full(&field, lines) != evaluate_reference(&field, lines) )
+            return mismatch("evaluate", &field, n);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    long long random_fields = RANDOM_FIELDS;
+    Random seed = 1;
+    char name[32];
+    int n;
+
+    for(n = 1; n < argc; ++n)
+    {
+        if(strcmp(argv[n], "-t") == 0 && n + 1 < argc)
+            trials = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-d") == 0 && n + 1 < argc)
+            max_depth = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-r") == 0 && n + 1 < argc)
+            random_fields = atol(argv[++n]);
+        else
+        if(strcmp(argv[n], "-s") == 0 && n + 1 < argc)
+            seed = strtoul(argv[++n], NULL, 10);
+        else
+        if(strcmp(argv[n], "-w") == 0 && n + 1 < argc)
+        {
+            if(!load_weights(argv[++n]))
+            {
+                fprintf(stderr, "Could not load weights from \"%s\"!\n", argv[n]);
+                return 1;
+            }
+        }
+        else
+        if(argv[n][0] == '-')
+        {
+            fprintf( stderr, "Usage: %s [-t trials] [-d depth] [-r random fields] "
+                             "[-s seed] [-w weights] [<game directory>]\n", argv[0] );
+            return 1;
+        }
+        else
+            dir = argv[n];
+    }
+    if(trials < 1 || seed == 0)
+    {
+        fprintf(stderr, "Invalid number of trials or seed!\n");
+        return 1;
+    }
+
+    game = load_game(dir);
+    if(!game)
+    {
+        fprintf(stderr, "Could not load game.\n");
+        return 1;
+    }
+    capture_samples();
+
+    printf("%-20s %10s %12s %12s\n", "kernel", "ops/trial", "median ns", "p99 ns");
+    if( !measure("copy+place", run_place) ||
+        !measure("place_reference", run_place_reference) ||
+        !measure("place+unplace", run_place_unplace) ||
+        !measure("evaluate", run_evaluate) ||
+        !measure("evaluate_full", run_evaluate_full) ||
+        !measure("evaluate_reference", run_evaluate_reference) )
+        return 1;
+    for(depth = 1; depth <= max_depth; ++depth)
+    {
+        sprintf(name, "search/%d (node)", depth);
+        if(!measure(name, run_search))
+            return 1;
+    }
+    if( !measure("load_game", run_load_game) ||
+        !measure("load_piece", run_load_piece) )
+        return 1;
+
+    if(random_fields > 0)
+    {
+        if(!check_kernels(random_fields, seed))
+            return 1;
+        printf("%lld random fields checked.\n", random_fields);
+    }
+    fprintf(stderr, "checksum %llx\n", checksum);
+    return 0;
+}
@@ -1,146 +1,207 @@
 #include "Base.h"
+#include "Beam.h"
+#include "Eval.h"
 #include "Gui.h"
+#include "Search.h"
 
-#define INF             999999999
-#define SEARCH_DEPTH            3
+#define BEAM_HORIZON           12
+#define FLUSH_INTERVAL        100   /* longest time moves stay buffered, in ms */
 
 Game *game;
+Output output;
 
-int evaluate(const Field *field, int score)
+int main(int argc, char *argv[])
 {
-    int x, y, boundaries = 0, h;
-
-    for(y = 0; y < FIELD_HEIGHT; ++y)
-    {
-        if(!field->tile[0][y])
-            ++boundaries;
-        if(!field->tile[FIELD_WIDTH - 1][y])
-            ++boundaries;
-        for(x = 1; x < FIELD_WIDTH; ++x)
-            if(field->tile[x - 1][y] != field->tile[x][y])
-                ++boundaries;
-    }
-
-    for(x = 0; x < FIELD_WIDTH; ++x)
+    Field field = { };
+    Tiles tiles = { };
+    Stats stats = { };
+    Searcher searcher = { };
+    Policy policy = { };
+    Beam *beam = NULL;
+    GUI *gui;
+    const char *dir = ".";
+    bool streaming = false, binary = false, exhaustive = false;
+    int threads = 1, table_size = TABLE_SIZE, n, used,
+        beam_width = 0, beam_horizon = BEAM_HORIZON,
+        depth_moves[MAX_DEPTH + 1] = { };
+    long long search_time = 0, longest = 0, depth_time[MAX_DEPTH + 1] = { },
+        start, flushed;
+
+    for(n = 1; n < argc; ++n)
     {
-        if(!field->tile[x][0])
-            ++boundaries;
-        for(y = 1; y < FIELD_HEIGHT; ++y)
-            if(field->tile[x][y - 1] != field->tile[x][y])
-                ++boundaries;
+        if((used = policy_parse(&policy, argc, argv, n)) < 0)
+            return 1;
+        else
+        if(used > 0)
+            n += used - 1;
+        else
+        if(strcmp(argv[n], "-j") == 0 && n + 1 < argc)
+            threads = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-t") == 0 && n + 1 < argc)
+            table_size = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-w") == 0 && n + 1 < argc)
+        {
+            if(!load_weights(argv[++n]))
+            {
+                fprintf(stderr, "Could not load weights from \"%s\"!\n", argv[n]);
+                return 1;
+            }
+        }
+        else
+        if(strcmp(argv[n], "-b") == 0 && n + 1 < argc)
+            beam_width = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-l") == 0 && n + 1 < argc)
+            beam_horizon = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-s") == 0)
+            streaming = true;
+        else
+        if(strcmp(argv[n], "-x") == 0)
+            exhaustive = true;
+        else
+        if(strcmp(argv[n], "-f") == 0 && n + 1 < argc)
+            binary = strcmp(argv[++n], "binary") == 0;
+        else
+            dir = argv[n];
     }
 
-    h = 0;
-    for(x = 0; x < FIELD_WIDTH; ++x)
-        h += field->top[x]*field->top[x];
+    policy_normalize(&policy);
 
-    return 1*score - boundaries - h;
-/*
-    for(x = 1; x < FIELD_WIDTH; ++x)
+    game = streaming ? stream_game(dir) : load_game(dir);
+    if(!game)
     {
-        int n = field->top[x - 1] - field->top[x];
-        if(n < 0)
-            n = -n;
-        if(n > 2)
-            val -= (2 + n)*(2 + n);
+        fprintf(stderr, "Could not load game.\n");
+        return 1;
     }
 
-    for(x = 0; x < FIELD_WIDTH; ++x)
+    if(beam_width > 0)
     {
-        val -= (field->top[x])*(field->top[x]);
-        for(y = 0; y < field->top[x]; ++y)
-            if(!field->tile[x][y])
-                val -= 50;
+        /* A streamed game can only be searched STREAM_AHEAD pieces ahead */
+        if(streaming && beam_horizon > STREAM_AHEAD/2)
+            beam_horizon = STREAM_AHEAD/2;
+        beam = beam_create(game, beam_width, beam_horizon > 0 ? beam_horizon : 1);
+        if(!beam)
+        {
+            fprintf(stderr, "Could not allocate beam search states!\n");
+            return 1;
+        }
+        table_size = 0;
     }
 
-    return val;
-*/
-}
-
-int search(const Field *field, int pos, int score, int depth, Move *best_move)
-{
-    Piece *piece = &game->piece[(int)game->input[pos]];
-    int best = -INF, val, rot, x, lines;
-
-    if(pos >= game->input_size)
-        return 0;
-
-    if(depth <= 0)
-        return evaluate(field, score);
-
-    for(rot = 0; rot < piece->forms; ++rot)
+    searcher.game = game;
+    searcher.exhaustive = exhaustive;
+    if(table_size > 0)
     {
-        Field new_field;
-        for(x = 0; x + piece->form[rot].width <= FIELD_WIDTH; ++x)
+        searcher.table = table_create((size_t)table_size << 20);
+        if(!searcher.table)
         {
-            new_field = *field;
-            lines = place(&new_field, &piece->form[rot], x);
-            if(lines >= 0)
-            {
-                val = search( &new_field, pos + 1, score + lines_score[lines],
-                              depth - 1, NULL);
-                if(val > best)
-                {
-                    best = val;
-                    if(best_move)
-                    {
-                        best_move->form = rot;
-                        best_move->xpos = x;
-                    }
-                }
-            }
+            fprintf(stderr, "Could not allocate transposition table!\n");
+            return 1;
         }
     }
-    return best;
-}
-
-int main(int argc, char *argv[])
-{
-    Field field = { };
-    Stats stats = { };
-    GUI *gui;
 
-    game = load_game((argc < 2) ? "." : argv[1]);
-    if(!game)
+    if(!search_create_threads(threads))
     {
-        fprintf(stderr, "Could not load game.\n");
+        fprintf(stderr, "Could not create search threads!\n");
         return 1;
     }
 
+    open_output(&output, STDOUT_FILENO, binary);
     gui = gui_create(game, "Player");
 
     if(gui)
-        gui_update(gui, &field, &stats, NULL, 0);
+        gui_update(gui, &field, &tiles, &stats, NULL, 0);
 
-    for(stats.pos = 0; stats.pos < game->input_size; ++stats.pos)
+    start = flushed = utime();
+    for(stats.pos = 0; has_piece(game, stats.pos); ++stats.pos)
     {
         Move best_move;
-        Form *form;
-
-        if(search(&field, stats.pos, 0, SEARCH_DEPTH, &best_move) < -INF/2)
+        Form *form = NULL;
+        long long t = utime();
+        int reached = 0;
+        bool found;
+
+        PROFILE_START(&searcher.profile);
+        if(beam)
+            found = beam_next_move(beam, &best_move);
+        else
+            found = choose_move( &searcher, &policy, &field, &stats,
+                                 t - start, &best_move, &reached );
+        PROFILE_STOP(&searcher.profile);
+
+        t = utime() - t;
+        search_time += t;
+        if(!beam)
+        {
+            depth_moves[reached] += 1;
+            depth_time[reached]  += t;
+        }
+        if(t > longest)
+            longest = t;
+        if(!found)
         {
             fprintf(stderr, "No suitable move found.\n");
             break;
         }
 
-        form = &game->piece[(int)game->input[stats.pos]].form[best_move.form];
-
         if(gui)
-            gui_update(gui, &field, &stats, form, best_move.xpos);
-
-        if(!update_field(&field, form, best_move.xpos, &stats))
+        {
+            if(best_move.form >= 0)
+                form = &game->piece[game_input(game, stats.pos)].
+                       form[best_move.form];
+            gui_update(gui, &field, &tiles, &stats, form, best_move.xpos);
+        }
+        if(!apply_move(&field, gui ? &tiles : NULL, game, best_move, &stats))
         {
             fprintf(stderr, "INTERNAL ERROR: invalid move selected!\n");
             break;
         }
 
-        print_move(stdout, game, best_move, &stats);
-        fflush(stdout);
+        write_move(&output, game, best_move, &stats);
+
+        /* A streamed game is played while it arrives, so each move is
+           passed on at once; otherwise moves are written in batches */
+        if(streaming || utime() - flushed >= 1000LL*FLUSH_INTERVAL)
+        {
+            if(!flush_output(&output))
+            {
+                fprintf(stderr, "Unable to write moves!\n");
+                break;
+            }
+            flushed = utime();
+        }
     }
 
+    if(!flush_output(&output))
+        fprintf(stderr, "Unable to write moves!\n");
+
     print_stats(stderr, &stats);
+    print_profile(stderr, &searcher.profile, searcher.nodes, searcher.places);
+    fprintf( stderr,
+        "Search threads:            %8d\n"
+        "Search time (ms):          %8lld\n"
+        "Nodes searched:            %8lld\n"
+        "Subtrees pruned:           %8lld\n"
+        "Table hits:                %8lld\n"
+        "Table misses:              %8lld\n",
+        threads, search_time/1000, searcher.nodes, searcher.pruned,
+        searcher.table_hits, searcher.table_misses );
+    for(n = 1; n <= MAX_DEPTH; ++n)
+        if(depth_moves[n] > 0)
+            fprintf( stderr, "Moves at depth %2d:         %8d (%.1f ms each)\n",
+                     n, depth_moves[n], depth_time[n]/1e3/depth_moves[n] );
+    fprintf(stderr, "Longest move (ms):         %8lld\n", longest/1000);
     fflush(stderr);
 
+    search_destroy_threads();
+    if(searcher.table)
+        table_destroy(searcher.table);
+    if(beam)
+        beam_destroy(beam);
+
     if(gui)
     {
         gui_wait(gui);
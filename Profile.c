@@ -0,0 +1,69 @@
+#define _POSIX_C_SOURCE 199309L     /* for clock_gettime() */
+#include "Profile.h"
+#include <time.h>
+
+#ifdef PROFILE
+
+/* Returns a monotonic time in nanoseconds. */
+long long profile_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ll*ts.tv_sec + ts.tv_nsec;
+}
+
+void profile_latency(Profile *p, long long ns)
+{
+    long long us = ns/1000;
+    int n = 0;
+
+    while(us > 1 && n < LATENCY_BUCKETS - 1)
+    {
+        us >>= 1;
+        ++n;
+    }
+    ++p->latency[n];
+}
+
+void profile_add(Profile *p, const Profile *q)
+{
+    int n, m;
+
+    p->evaluations += q->evaluations;
+    p->rejected    += q->rejected;
+    for(n = 0; n < PROFILE_DEPTHS; ++n)
+        for(m = 0; m < 6; ++m)
+            p->lines[n][m] += q->lines[n][m];
+    for(n = 0; n < LATENCY_BUCKETS; ++n)
+        p->latency[n] += q->latency[n];
+}
+
+/* Prints the counters as lines of the form "profile <name> <values>":
+   placements by depth left as "lines <depth> <count for 0 .. 5 lines>",
+   move latencies as "latency_us <lower bound> <moves>". */
+void print_profile(FILE *fp, const Profile *p, long long nodes, long long places)
+{
+    int n, m;
+
+    fprintf(fp, "profile nodes %lld\n", nodes);
+    fprintf(fp, "profile places %lld\n", places);
+    fprintf(fp, "profile rejected %lld\n", p->rejected);
+    fprintf(fp, "profile evaluations %lld\n", p->evaluations);
+    for(n = 0; n < PROFILE_DEPTHS; ++n)
+    {
+        long long total = 0;
+        for(m = 0; m < 6; ++m)
+            total += p->lines[n][m];
+        if(total == 0)
+            continue;
+        fprintf(fp, "profile lines %d", n);
+        for(m = 0; m < 6; ++m)
+            fprintf(fp, " %lld", p->lines[n][m]);
+        fprintf(fp, "\n");
+    }
+    for(n = 0; n < LATENCY_BUCKETS; ++n)
+        if(p->latency[n] > 0)
+            fprintf(fp, "profile latency_us %lld %lld\n", n ? 1ll << n : 0ll, p->latency[n]);
+}
+
+#endif /* def PROFILE */
@@ -0,0 +1,45 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "Base.h"
+
+/* Hot-path counters and move latencies, only kept in builds with -DPROFILE.
+   Otherwise the macros below compile to nothing. */
+
+#define PROFILE_DEPTHS         32
+#define LATENCY_BUCKETS        32
+
+#ifdef PROFILE
+
+typedef struct Profile
+{
+    long long   evaluations, rejected;
+    long long   lines[PROFILE_DEPTHS][6];   /* placements by depth left and
+                                               lines cleared */
+    long long   latency[LATENCY_BUCKETS];   /* moves by search time: below
+                                               2 us, then 2^n to 2^(n+1) us */
+    long long   started;                    /* profile_clock() of the move */
+} Profile;
+
+#define PROFILE_COUNT(p, counter)   (++(p)->counter)
+#define PROFILE_LINES(p, depth, n)  \
+    (++(p)->lines[(depth) < PROFILE_DEPTHS ? (depth) : PROFILE_DEPTHS - 1][n])
+#define PROFILE_START(p)            ((p)->started = profile_clock())
+#define PROFILE_STOP(p)             profile_latency((p), profile_clock() - (p)->started)
+
+long long profile_clock(void);
+void profile_latency(Profile *p, long long ns);
+void profile_add(Profile *p, const Profile *q);
+void print_profile(FILE *fp, const Profile *p, long long nodes, long long places);
+
+#else /* ndef PROFILE */
+
+#define PROFILE_COUNT(p, counter)   ((void)0)
+#define PROFILE_LINES(p, depth, n)  ((void)0)
+#define PROFILE_START(p)            ((void)0)
+#define PROFILE_STOP(p)             ((void)0)
+#define print_profile(fp, p, nodes, places) ((void)0)
+
+#endif /* def PROFILE */
+
+#endif /* ndef PROFILE_H */
@@ -0,0 +1,818 @@
+#include "Search.h"
+#include "Eval.h"
+#include <pthread.h>
+#include <sched.h>
+
+/* Nodes searched at least this deep hand their children to the thread pool;
+   shallower subtrees are searched serially by whichever thread picks them up. */
+#define SPLIT_DEPTH             2
+#define QUEUE_SIZE           1024
+
+/* The children of a node searched by the thread pool share the best value
+   found so far, by which a child is skipped if its bound cannot beat it.
+   As in search_children(), a child before the best move in move order
+   only needs to tie it at the root. */
+typedef struct Split
+{
+    pthread_mutex_t lock;
+    int best, best_n, alpha;
+    bool prune, root;
+} Split;
+
+typedef struct Task
+{
+    Field field;
+    int pos, score, depth;
+    int bound, index;       /* upper bound on the value, move index */
+    Move move;
+    int value;              /* static evaluation until searched */
+    Split *split;
+    int *pending;
+} Task;
+
+/* Each worker owns a deque of tasks. The owner pushes and pops at the tail,
+   idle workers steal from the head of other workers' deques. */
+typedef struct Worker
+{
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    Searcher        searcher;
+    Task            *queue[QUEUE_SIZE];
+    int             head, tail;
+} Worker;
+
+static Worker *workers;
+static int num_workers;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static volatile bool searching, stopping, timed_out;
+
+/* Returns whether the value of a node may be kept in the transposition
+   table. Values are stored relative to the weighted score accumulated
+   before the node, which does not hold for subtrees that reach the end of
+   the game: their leaves at position input_size are worth 0, whatever the
+   score. */
+static bool use_table(const Searcher *s, int pos, int depth, Move *best_move)
+{
+    return s->table && !best_move && depth >= TABLE_MIN_DEPTH &&
+           pos + depth < s->game->input_size;
+}
+
+/* Returns whether the searcher's deadline has passed (for any thread),
+   only reading the clock every 1024 nodes. */
+static bool out_of_time(const Searcher *s)
+{
+    if((s->nodes & 1023) == 0 && utime() > s->deadline)
+        timed_out = true;
+    return timed_out;
+}
+
+static bool lookup(Searcher *s, Hash key, int pos, int depth, int *value)
+{
+    if(table_lookup(s->table, key, pos, depth, value))
+    {
+        ++s->table_hits;
+        return true;
+    }
+    ++s->table_misses;
+    return false;
+}
+
+/* Returns the number of tiles of the 'pieces' pieces from 'pos' on. */
+static int future_tiles(const Game *game, int pos, int pieces)
+{
+    const Form *form;
+    int tiles = 0, n, m;
+
+    for(n = 0; n < pieces; ++n)
+    {
+        form = &game->piece[game_input(game, pos + n)].form[0];
+        for(m = 0; m < form->height; ++m)
+            tiles += count_bits(form->mask[m]);
+    }
+    return tiles;
+}
+
+/* Returns the most rows that 'tiles' more tiles can clear from a field.
+   Each row cleared is a row of the field (or an empty row above it) that
+   has all its free tiles filled, so the rows missing the fewest tiles
+   are counted first. */
+static int max_clears(const Field *field, int tiles)
+{
+    int missing[FIELD_WIDTH + 1] = { }, y, n, lines = 0;
+
+    for(y = 0; y < FIELD_HEIGHT && field->row[y]; ++y)
+        ++missing[FIELD_WIDTH - count_bits(field->row[y])];
+    missing[FIELD_WIDTH] += FIELD_HEIGHT - y;
+    for(n = 1; n <= FIELD_WIDTH && tiles >= n; ++n)
+        for( ; missing[n] > 0 && tiles >= n; --missing[n], ++lines)
+            tiles -= n;
+    return lines;
+}
+
+/* Returns the highest score that 'pieces' pieces clearing 'lines' rows
+   can add. Clearing rows pays more the more are cleared at once, so the
+   rows are cleared PIECE_SIZE at a time. */
+static int max_gain(int pieces, int lines)
+{
+    int gain = 0, n;
+
+    for(n = 0; n < pieces; ++n, lines -= PIECE_SIZE)
+        gain += lines_score[lines < 0 ? 0 : lines < PIECE_SIZE ? lines : PIECE_SIZE];
+    return gain;
+}
+
+/* Returns an upper bound on the value of a child with 'field' and 'score'
+   whose subtree places 'pieces' more pieces of 'tiles' tiles, or reaches
+   the end of the game, where every leaf is worth 0, if 'ends'. */
+static int child_bound( const Field *field, int score, int pieces, int tiles,
+                        bool ends )
+{
+    int lines;
+
+    if(ends)
+        return 0;
+    lines = max_clears(field, tiles);
+    return evaluate_bound(field, score + max_gain(pieces, lines), lines, tiles);
+}
+
+/* Returns whether a node of 'depth' prunes its children by their bounds. */
+static bool prunes(const Searcher *s, int depth)
+{
+    return depth >= PRUNE_MIN_DEPTH && !s->exhaustive && bound_admissible();
+}
+
+static int search_field( Searcher *s, Field *field, int pos, int score,
+                         int depth, int alpha, Move *best_move );
+
+/* A child of a node searched by search_children(): the field after a
+   move, the score its lines earned, and its static evaluation, by which
+   the children are ordered. */
+typedef struct Child
+{
+    Field field;
+    int gain, value, move;
+} Child;
+
+/* Places the piece of a node in every way it fits, storing the children
+   in 'child'. Returns the number of children. */
+static int expand_children( Searcher *s, const Field *field, int pos,
+                            int score, int depth, Child *child )
+{
+    const Piece *piece = &s->game->piece[game_input(s->game, pos)];
+    Child *c;
+    int n, lines, children = 0;
+
+    for(n = 0; n < piece->moves; ++n)
+    {
+        const Move *move = &piece->move[n];
+        c = &child[children];
+        ++s->places;
+        c->field = *field;
+        lines = place(&c->field, &piece->form[move->form], move->xpos);
+        if(lines < 0)
+        {
+            PROFILE_COUNT(&s->profile, rejected);
+            continue;
+        }
+        PROFILE_LINES(&s->profile, depth, lines);
+        c->gain  = lines_score[lines];
+        c->value = evaluate(&c->field, score + c->gain);
+        c->move  = n;
+        ++children;
+    }
+    return children;
+}
+
+/* Searches the children of a node best first, and skips those whose upper
+   bound cannot beat the best value found so far or 'alpha'. A child
+   before the best move in move order only needs to tie it, so the best
+   move is the first one of the highest value, as without pruning. Returns
+   an upper bound if no child beats 'alpha', and the exact value
+   otherwise. */
+static int search_children( Searcher *s, Field *field, int pos, int score,
+                            int depth, int alpha, Move *best_move )
+{
+    const Piece *piece = &s->game->piece[game_input(s->game, pos)];
+    Child child[4*FIELD_WIDTH], *c;
+    int order[4*FIELD_WIDTH], children, best = -INF, best_n = piece->moves;
+    int pieces, tiles, limit, bound, val, n, m;
+    bool ends;
+
+    /* The subtree of each child places 'pieces' more pieces, or reaches the
+       end of the game, where every leaf is worth 0 */
+    pieces = depth - 1;
+    ends = pos + 1 + pieces >= s->game->input_size;
+    tiles = ends ? 0 : future_tiles(s->game, pos + 1, pieces);
+
+    children = expand_children(s, field, pos, score, depth, child);
+    for(n = 0; n < children; ++n)
+    {
+        for(m = n; m > 0 && child[order[m - 1]].value < child[n].value; --m)
+            order[m] = order[m - 1];
+        order[m] = n;
+    }
+
+    for(n = 0; n < children; ++n)
+    {
+        c = &child[order[n]];
+        limit = (best_move && c->move < best_n) ? best - 1 : best;
+        if(limit < alpha)
+            limit = alpha;
+        bound = child_bound(&c->field, score + c->gain, pieces, tiles, ends);
+        if(bound <= limit)
+        {
+            ++s->pruned;
+            continue;
+        }
+        val = search_field( s, &c->field, pos + 1, score + c->gain,
+                            depth - 1, limit, NULL );
+        if(val > limit)
+        {
+            best = val;
+            best_n = c->move;
+        }
+    }
+    if(best_move && best_n < piece->moves)
+        *best_move = piece->move[best_n];
+    return best;
+}
+
+/* Searches from a field that is modified during the search, but restored
+   before returning. Subtrees that cannot beat 'alpha' may be pruned, in
+   which case the value returned is only an upper bound. */
+static int search_field( Searcher *s, Field *field, int pos, int score,
+                         int depth, int alpha, Move *best_move )
+{
+    const Piece *piece;
+    int best = -INF, val, n, lines;
+    bool cache;
+
+    ++s->nodes;
+    if(s->deadline && out_of_time(s))
+        return -INF;
+    if(pos >= s->game->input_size)
+        return 0;
+
+    if(depth <= 0)
+    {
+        PROFILE_COUNT(&s->profile, evaluations);
+        return evaluate(field, score);
+    }
+
+    cache = use_table(s, pos, depth, best_move);
+    if(cache && lookup(s, field->hash, pos, depth, &val))
+        return weight[W_SCORE]*score + val;
+
+    if(prunes(s, depth))
+        best = search_children(s, field, pos, score, depth, alpha, best_move);
+    else
+    {
+        /* Taking placements back is cheaper than copying the field with
+           its id planes for each child (see microbench) */
+        piece = &s->game->piece[game_input(s->game, pos)];
+        for(n = 0; n < piece->moves; ++n)
+        {
+            const Move *move = &piece->move[n];
+            Undo undo;
+            ++s->places;
+            lines = place_reversibly( field, &piece->form[move->form],
+                                      move->xpos, &undo );
+            if(lines < 0)
+                PROFILE_COUNT(&s->profile, rejected);
+            else
+            {
+                PROFILE_LINES(&s->profile, depth, lines);
+                val = search_field( s, field, pos + 1, score + lines_score[lines],
+                                    depth - 1, -INF, NULL );
+                unplace(field, &undo);
+                if(val > best)
+                {
+                    best = val;
+                    if(best_move)
+                        *best_move = *move;
+                }
+            }
+        }
+    }
+    if(cache && best > alpha && best > -INF/2 && !timed_out)
+        table_store(s->table, field->hash, pos, depth, best - weight[W_SCORE]*score);
+    return best;
+}
+
+int search( Searcher *s, const Field *field, int pos, int score,
+            int depth, Move *best_move )
+{
+    Field copy = *field;
+    return search_field(s, &copy, pos, score, depth, -INF, best_move);
+}
+
+static bool push_task(Worker *w, Task *task)
+{
+    bool pushed = false;
+    pthread_mutex_lock(&w->lock);
+    if(w->tail - w->head < QUEUE_SIZE)
+    {
+        w->queue[w->tail++%QUEUE_SIZE] = task;
+        pushed = true;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return pushed;
+}
+
+static Task *pop_task(Worker *w)
+{
+    Task *task = NULL;
+    pthread_mutex_lock(&w->lock);
+    if(w->tail > w->head)
+        task = w->queue[--w->tail%QUEUE_SIZE];
+    pthread_mutex_unlock(&w->lock);
+    return task;
+}
+
+static Task *steal_task(Worker *w)
+{
+    Task *task = NULL;
+    int n;
+
+    for(n = 1; n < num_workers && !task; ++n)
+    {
+        Worker *victim = &workers[(w - workers + n)%num_workers];
+        pthread_mutex_lock(&victim->lock);
+        if(victim->tail > victim->head)
+            task = victim->queue[victim->head++%QUEUE_SIZE];
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return task;
+}
+
+static int expand( Worker *w, const Field *field, int pos, int score,
+                   int depth, int alpha, Move *best_move );
+
+/* Returns the value a child with move index 'n' has to beat. */
+static int split_limit(Split *split, int n)
+{
+    int limit;
+
+    pthread_mutex_lock(&split->lock);
+    limit = (split->root && n < split->best_n) ? split->best - 1 : split->best;
+    if(limit < split->alpha)
+        limit = split->alpha;
+    pthread_mutex_unlock(&split->lock);
+    return limit;
+}
+
+static void split_update(Split *split, int value, int n)
+{
+    pthread_mutex_lock(&split->lock);
+    if(value > split->best || (value == split->best && n < split->best_n))
+    {
+        split->best   = value;
+        split->best_n = n;
+    }
+    pthread_mutex_unlock(&split->lock);
+}
+
+/* Searches a child, unless its bound cannot beat the best value of its
+   siblings so far. Values that do not beat it are only upper bounds. */
+static void run_task(Worker *w, Task *task)
+{
+    Split *split = task->split;
+    int limit = split->prune ? split_limit(split, task->index) : -INF;
+
+    if(split->prune && task->bound <= limit)
+    {
+        ++w->searcher.pruned;
+        task->value = -INF;
+    }
+    else
+    {
+        task->value = expand( w, &task->field, task->pos, task->score,
+                              task->depth, limit, NULL );
+        if(task->value > limit)
+            split_update(split, task->value, task->index);
+    }
+    __sync_sub_and_fetch(task->pending, 1);
+}
+
+/* Works on queued tasks until '*pending' drops to zero. */
+static void help_until_done(Worker *w, int *pending)
+{
+    while(__sync_add_and_fetch(pending, 0) > 0)
+    {
+        Task *task = pop_task(w);
+        if(!task)
+            task = steal_task(w);
+        if(task)
+            run_task(w, task);
+        else
+            sched_yield();
+    }
+}
+
+/* Searches like search_field(), but queues the children of deep nodes as
+   tasks for the thread pool, best first by their static evaluation, and
+   prunes them the same way. Children are combined in move order, so the
+   result does not depend on how the work was scheduled. */
+static int expand( Worker *w, const Field *field, int pos, int score,
+                   int depth, int alpha, Move *best_move )
+{
+    Searcher *s = &w->searcher;
+    Task task[4*FIELD_WIDTH];
+    Split split;
+    Field copy;
+    const Piece *piece;
+    int order[4*FIELD_WIDTH], best = -INF, lines, n, m;
+    int tasks = 0, pending, pieces, tiles;
+    bool cache, ends;
+
+    if(depth < SPLIT_DEPTH || pos >= s->game->input_size)
+    {
+        copy = *field;
+        return search_field(s, &copy, pos, score, depth, alpha, best_move);
+    }
+
+    ++s->nodes;
+    if(s->deadline && out_of_time(s))
+        return -INF;
+    cache = use_table(s, pos, depth, best_move);
+    if(cache && lookup(s, field->hash, pos, depth, &best))
+        return weight[W_SCORE]*score + best;
+
+    split.best   = -INF;
+    split.best_n = 4*FIELD_WIDTH;
+    split.alpha  = alpha;
+    split.prune  = prunes(s, depth);
+    split.root   = best_move != NULL;
+    pieces = depth - 1;
+    ends = pos + 1 + pieces >= s->game->input_size;
+    tiles = (ends || !split.prune) ? 0 : future_tiles(s->game, pos + 1, pieces);
+
+    piece = &s->game->piece[game_input(s->game, pos)];
+    for(n = 0; n < piece->moves; ++n)
+    {
+        const Move *move = &piece->move[n];
+        Task *t = &task[tasks];
+        ++s->places;
+        t->field = *field;
+        lines = place(&t->field, &piece->form[move->form], move->xpos);
+        if(lines < 0)
+        {
+            PROFILE_COUNT(&s->profile, rejected);
+            continue;
+        }
+        PROFILE_LINES(&s->profile, depth, lines);
+        t->pos      = pos + 1;
+        t->score    = score + lines_score[lines];
+        t->depth    = depth - 1;
+        t->index    = n;
+        t->move     = *move;
+        t->value    = evaluate(&t->field, t->score);
+        ++tasks;
+    }
+    for(n = 0; n < tasks; ++n)
+    {
+        task[n].split   = &split;
+        task[n].pending = &pending;
+        if(split.prune)
+            task[n].bound = child_bound( &task[n].field, task[n].score,
+                                         pieces, tiles, ends );
+        for(m = n; m > 0 && task[order[m - 1]].value < task[n].value; --m)
+            order[m] = order[m - 1];
+        order[m] = n;
+    }
+
+    /* Push in reverse, so the owner pops the best child first. */
+    pthread_mutex_init(&split.lock, NULL);
+    pending = tasks;
+    for(n = tasks - 1; n >= 0; --n)
+        if(!push_task(w, &task[order[n]]))
+            run_task(w, &task[order[n]]);
+    help_until_done(w, &pending);
+    pthread_mutex_destroy(&split.lock);
+
+    for(n = 0; n < tasks; ++n)
+        if(task[n].value > best)
+        {
+            best = task[n].value;
+            if(best_move)
+                *best_move = task[n].move;
+        }
+    if(cache && best > alpha && best > -INF/2 && !timed_out)
+        table_store(s->table, field->hash, pos, depth, best - weight[W_SCORE]*score);
+    return best;
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *w = arg;
+
+    pthread_mutex_lock(&pool_lock);
+    for(;;)
+    {
+        while(!searching && !stopping)
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        if(stopping)
+            break;
+        pthread_mutex_unlock(&pool_lock);
+
+        while(searching)
+        {
+            Task *task = pop_task(w);
+            if(!task)
+                task = steal_task(w);
+            if(task)
+                run_task(w, task);
+            else
+                sched_yield();
+        }
+
+        pthread_mutex_lock(&pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+/* Creates a pool of 'threads' workers, including the calling thread. */
+bool search_create_threads(int threads)
+{
+    int n;
+
+    if(threads < 1)
+        threads = 1;
+    workers = calloc(threads, sizeof(*workers));
+    if(!workers)
+        return false;
+    stopping = false;
+    for(n = 0; n < threads; ++n)
+        pthread_mutex_init(&workers[n].lock, NULL);
+    num_workers = 1;
+    for(n = 1; n < threads; ++n)
+    {
+        if(pthread_create(&workers[n].thread, NULL, worker_main, &workers[n]) != 0)
+        {
+            search_destroy_threads();
+            return false;
+        }
+        ++num_workers;
+    }
+    return true;
+}
+
+void search_destroy_threads(void)
+{
+    int n;
+
+    pthread_mutex_lock(&pool_lock);
+    stopping = true;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    for(n = 1; n < num_workers; ++n)
+        pthread_join(workers[n].thread, NULL);
+    for(n = 0; n < num_workers; ++n)
+        pthread_mutex_destroy(&workers[n].lock);
+    free(workers);
+    workers = NULL;
+    num_workers = 0;
+}
+
+/* Like search(), but distributes the work over the thread pool created by
+   search_create_threads() (or searches serially if there is none). */
+int search_parallel( Searcher *s, const Field *field, int pos,
+                     int depth, Move *best_move )
+{
+    int best, n;
+
+    if(num_workers <= 1)
+        return search(s, field, pos, 0, depth, best_move);
+
+    for(n = 0; n < num_workers; ++n)
+    {
+        workers[n].searcher = *s;
+        workers[n].searcher.table_hits = workers[n].searcher.table_misses = 0;
+        workers[n].searcher.nodes = workers[n].searcher.places = 0;
+        workers[n].searcher.pruned = 0;
+#ifdef PROFILE
+        memset(&workers[n].searcher.profile, 0, sizeof(Profile));
+#endif
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    searching = true;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    best = expand(&workers[0], field, pos, 0, depth, -INF, best_move);
+
+    searching = false;
+    for(n = 0; n < num_workers; ++n)
+    {
+        s->table_hits   += workers[n].searcher.table_hits;
+        s->table_misses += workers[n].searcher.table_misses;
+        s->nodes        += workers[n].searcher.nodes;
+        s->places       += workers[n].searcher.places;
+        s->pruned       += workers[n].searcher.pruned;
+#ifdef PROFILE
+        profile_add(&s->profile, &workers[n].searcher.profile);
+#endif
+    }
+    return best;
+}
+
+/* Returns how far 'value' has come from 'calm' towards 'danger', from 0 (at
+   or below 'calm') to DANGER_LEVEL (at or above 'danger'). */
+static int danger_level(int value, int calm, int danger)
+{
+    if(value <= calm)
+        return 0;
+    if(value >= danger)
+        return DANGER_LEVEL;
+    return DANGER_LEVEL*(value - calm)/(danger - calm);
+}
+
+/* Picks the depth to search the piece at 'pos' at. While the stack is low
+   and has few boundaries and holes, that is 'min_depth'. Otherwise it is
+   'base_depth' and more, in proportion to the greatest danger the height,
+   the boundaries or the holes of the stack show, and 'max_depth' once a
+   placement of the piece no longer fits. */
+static int adaptive_depth( const Searcher *s, const Field *field, int pos,
+                           int min_depth, int base_depth, int max_depth )
+{
+    const Piece *piece = &s->game->piece[game_input(s->game, pos)];
+    int height = 0, holes = 0, level, n, x, y;
+
+    for(n = 0; n < piece->moves; ++n)
+    {
+        const Form *form = &piece->form[piece->move[n].form];
+
+        if( drop_height(field, form, piece->move[n].xpos) + form->height >
+            FIELD_HEIGHT )
+            return max_depth;
+    }
+
+    /* Every occupied tile lies below the top of its column, and no tile
+       lies above an empty row */
+    for(x = 0; x < FIELD_WIDTH; ++x)
+    {
+        holes += field->top[x];
+        if(field->top[x] > height)
+            height = field->top[x];
+    }
+    for(y = 0; y < FIELD_HEIGHT && field->row[y]; ++y)
+        holes -= count_bits(field->row[y]);
+
+    if( height <= CALM_HEIGHT && field->boundaries <= CALM_BOUNDARIES &&
+        holes <= CALM_HOLES )
+        return min_depth;
+
+    level = danger_level(height, CALM_HEIGHT, DANGER_HEIGHT);
+    n = danger_level(field->boundaries, CALM_BOUNDARIES, DANGER_BOUNDARIES);
+    if(n > level)
+        level = n;
+    n = danger_level(holes, CALM_HOLES, DANGER_HOLES);
+    if(n > level)
+        level = n;
+    return base_depth + ((max_depth - base_depth)*level + DANGER_LEVEL/2)/
+                        DANGER_LEVEL;
+}
+
+/* Searches with iterative deepening, one ply deeper at a time up to
+   'max_depth'. No new iteration is started once 'soft' microseconds have
+   passed, or half that if the last iteration did not change the best move;
+   a running iteration is abandoned after 'hard' microseconds (0 means no
+   limit). The first iteration always completes. Returns the value of the
+   deepest completed iteration that found a move, and stores its move in
+   'best_move' and its depth in '*depth'. */
+int search_iterative( Searcher *s, const Field *field, int pos,
+                      int max_depth, long long soft, long long hard,
+                      Move *best_move, int *depth )
+{
+    long long start = utime(), elapsed;
+    int best = -INF, val, d;
+    bool contested;
+    Move move;
+
+    if(max_depth > s->game->input_size - pos)
+        max_depth = s->game->input_size - pos;
+    *depth = 0;
+    for(d = 1; d <= max_depth; ++d)
+    {
+        s->deadline = (d > 1 && hard > 0) ? start + hard : 0;
+        timed_out = false;
+        val = search_parallel(s, field, pos, d, &move);
+        if(timed_out || (d > 1 && val <= -INF/2))
+            break;
+        contested = d > 1 && ( move.form != best_move->form ||
+                               move.xpos != best_move->xpos );
+        best = val;
+        *best_move = move;
+        *depth = d;
+        if(best <= -INF/2)
+            break;
+        elapsed = utime() - start;
+        if(soft > 0 && elapsed >= (contested ? soft : soft/2))
+            break;
+    }
+    s->deadline = 0;
+    timed_out = false;
+    return best;
+}
+
+/* Reads the policy option argv[n] and its argument into 'policy'. Returns
+   the number of arguments read, 0 if argv[n] is not a policy option, or -1
+   (after printing why) if its argument is invalid. */
+int policy_parse(Policy *policy, int argc, char *argv[], int n)
+{
+    if(n + 1 >= argc)
+        return 0;
+
+    if(strcmp(argv[n], "-d") == 0)
+        policy->depth = atoi(argv[n + 1]);
+    else
+    if(strcmp(argv[n], "-a") == 0)
+    {
+        if(sscanf( argv[n + 1], "%d-%d", &policy->min_depth,
+                   &policy->max_depth ) == 1)
+        {
+            policy->max_depth = policy->min_depth;
+            policy->min_depth = 1;
+        }
+        if(policy->min_depth < 1 || policy->min_depth > policy->max_depth)
+        {
+            fprintf( stderr, "Invalid depth range \"%s\" (-a min-max needs "
+                             "1 <= min <= max)!\n", argv[n + 1] );
+            return -1;
+        }
+    }
+    else
+    if(strcmp(argv[n], "-m") == 0)
+        policy->move_time = 1000LL*atoi(argv[n + 1]);
+    else
+    if(strcmp(argv[n], "-T") == 0)
+        policy->budget = 1000LL*atoi(argv[n + 1]);
+    else
+        return 0;
+    return 2;
+}
+
+/* Fills in the defaults of a parsed policy and brings its settings into
+   range. With a time limit, the depth only bounds the iterative deepening.
+   An adaptive depth range holds the base depth. */
+void policy_normalize(Policy *policy)
+{
+    if(policy->depth <= 0)
+        policy->depth = (policy->move_time > 0 || policy->budget > 0) ?
+                        MAX_DEPTH : SEARCH_DEPTH;
+    if(policy->depth > MAX_DEPTH)
+        policy->depth = MAX_DEPTH;
+    if(policy->min_depth <= 0)
+        return;
+    if(policy->max_depth > MAX_DEPTH)
+        policy->max_depth = MAX_DEPTH;
+    if(policy->min_depth > policy->max_depth)
+        policy->min_depth = policy->max_depth;
+    if(policy->depth < policy->min_depth)
+        policy->depth = policy->min_depth;
+    if(policy->depth > policy->max_depth)
+        policy->depth = policy->max_depth;
+}
+
+/* Chooses the move for the piece at stats->pos as 'policy' says, with
+   'elapsed' microseconds of the game's budget spent. Stores the move in
+   'move' and the depth it was searched at in '*depth'. Returns false if no
+   move was found. */
+bool choose_move( Searcher *s, const Policy *policy, const Field *field,
+                  const Stats *stats, long long elapsed, Move *move,
+                  int *depth )
+{
+    long long soft = policy->move_time, hard = policy->move_time, left, share;
+
+    *depth = policy->depth;
+    if(policy->min_depth > 0)
+        *depth = adaptive_depth( s, field, stats->pos, policy->min_depth,
+                                 policy->depth, policy->max_depth );
+    if(policy->move_time <= 0 && policy->budget <= 0)
+        return search_parallel(s, field, stats->pos, *depth, move) > -INF/2;
+
+    /* With a time limit, the depth only bounds the iterative deepening.
+       Each remaining piece gets an equal share of the budget left, which
+       contested moves may exceed. */
+    if(policy->budget > 0)
+    {
+        left  = policy->budget - elapsed;
+        share = left/(s->game->input_size - stats->pos);
+        if(share < 1)
+            share = 1;
+        if(soft <= 0 || soft > share)
+            soft = share;
+        if(hard <= 0 || hard > HARD_LIMIT*share)
+            hard = HARD_LIMIT*share;
+        if(hard > left)
+            hard = left > 1 ? left : 1;
+    }
+    return search_iterative( s, field, stats->pos, *depth, soft, hard,
+                             move, depth ) > -INF/2;
+}
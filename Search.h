@@ -0,0 +1,83 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "Base.h"
+#include "Profile.h"
+#include "Table.h"
+
+#define INF             999999999
+
+#define SEARCH_DEPTH            3   /* default search depth */
+#define MAX_DEPTH              20   /* default (and largest) timed search depth */
+
+#define TABLE_SIZE              0   /* default transposition table size in MB
+                                       (none, as it rarely hits at low depths) */
+
+/* Transposition table lookups are only done for nodes at least this deep. */
+#define TABLE_MIN_DEPTH         2
+
+/* Nodes at least this deep search their children in order of their static
+   evaluation, and prune those that cannot beat the best value so far. */
+#define PRUNE_MIN_DEPTH         2
+
+/* adaptive_depth() searches at the least depth while the stack is at most
+   CALM_HEIGHT high, has at most CALM_BOUNDARIES boundaries in excess of an
+   empty field and at most CALM_HOLES holes. Past that it searches at the
+   base depth and deeper, up to the greatest depth once the height, the
+   boundaries or the holes reach their DANGER_ value. DANGER_LEVEL is the
+   scale the danger is measured on. */
+#define CALM_HEIGHT             (FIELD_HEIGHT/4)
+#define CALM_BOUNDARIES         FIELD_WIDTH
+#define CALM_HOLES              FIELD_WIDTH
+#define DANGER_HEIGHT           (FIELD_HEIGHT/2)
+#define DANGER_BOUNDARIES       (DANGER_HEIGHT*FIELD_WIDTH)
+#define DANGER_HOLES            (2*FIELD_WIDTH)
+#define DANGER_LEVEL            1000
+
+#define HARD_LIMIT              4   /* longest move, in shares of the budget */
+
+/* How the moves of a game are chosen. The player, the benchmark and the
+   tuner all go through choose_move(), so they play the same way. */
+typedef struct Policy
+{
+    int         depth;          /* search depth (greatest with time limits) */
+    int         min_depth;      /* least adaptive depth (0: fixed depth) */
+    int         max_depth;      /* greatest adaptive depth */
+    long long   move_time;      /* microseconds per move (0: no limit) */
+    long long   budget;         /* microseconds per game (0: no limit) */
+} Policy;
+
+/* The options read by policy_parse(), for usage messages. */
+#define POLICY_USAGE    "[-d depth] [-a min-max] [-m move ms] [-T game ms]"
+
+typedef struct Searcher
+{
+    const Game  *game;
+    Table       *table;         /* transposition table (optional) */
+    long long   table_hits, table_misses;
+    long long   nodes, places;  /* nodes searched and placements tried */
+    long long   pruned;         /* subtrees skipped by their upper bound */
+    bool        exhaustive;     /* search without pruning */
+    long long   deadline;       /* utime() at which to give up (0: never) */
+#ifdef PROFILE
+    Profile     profile;
+#endif
+} Searcher;
+
+int search( Searcher *s, const Field *field, int pos, int score,
+            int depth, Move *best_move );
+
+bool search_create_threads(int threads);
+void search_destroy_threads(void);
+int search_parallel( Searcher *s, const Field *field, int pos,
+                     int depth, Move *best_move );
+int search_iterative( Searcher *s, const Field *field, int pos,
+                      int max_depth, long long soft, long long hard,
+                      Move *best_move, int *depth );
+int policy_parse(Policy *policy, int argc, char *argv[], int n);
+void policy_normalize(Policy *policy);
+bool choose_move( Searcher *s, const Policy *policy, const Field *field,
+                  const Stats *stats, long long elapsed, Move *move,
+                  int *depth );
+
+#endif /* ndef SEARCH_H */
@@ -0,0 +1,100 @@
+#include "Table.h"
+
+#define BUCKET_SIZE     4
+
+/* The data word holds the value in its low 32 bits and the position and
+   depth in its high 32 bits. The check word is the field hash xor'ed with
+   the data, so an entry torn by concurrent writes fails verification
+   instead of returning a wrong value. */
+typedef struct Entry
+{
+    Hash check, data;
+} Entry;
+
+struct Table
+{
+    size_t mask;
+    Entry (*bucket)[BUCKET_SIZE];
+};
+
+#define ENTRY_INFO(pos, depth)  ((Hash)(pos) << 36 | (Hash)(depth) << 32)
+
+/* Entries are replaced in order of the node's position plus its depth (i.e.
+   the last piece it looked at), so entries left over from searches for
+   earlier pieces go first, and then those that are cheapest to recompute. */
+#define ENTRY_PRIORITY(data)    \
+    (((data) >> 36) + ((data) >> 32 & 15))*16 + ((data) >> 32 & 15)
+
+/* Creates a table using at most 'size' bytes of memory. */
+Table *table_create(size_t size)
+{
+    Table *table;
+    size_t buckets = 1;
+
+    while(2*buckets*sizeof(*table->bucket) <= size)
+        buckets *= 2;
+
+    table = malloc(sizeof(*table));
+    if(!table)
+        return NULL;
+    table->mask   = buckets - 1;
+    table->bucket = calloc(buckets, sizeof(*table->bucket));
+    if(!table->bucket)
+    {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+void table_destroy(Table *table)
+{
+    free(table->bucket);
+    free(table);
+}
+
+static Entry *find_bucket(const Table *table, Hash hash, int pos)
+{
+    return table->bucket[(hash ^ (Hash)pos*0x9E3779B97F4A7C15ull) & table->mask];
+}
+
+bool table_lookup(const Table *table, Hash hash, int pos, int depth, int *value)
+{
+    Entry *entry = find_bucket(table, hash, pos);
+    int n;
+
+    if(depth > TABLE_MAX_DEPTH)
+        return false;
+
+    for(n = 0; n < BUCKET_SIZE; ++n)
+    {
+        Hash data = entry[n].data;
+        if( (data & 0xFFFFFFFF00000000ull) == ENTRY_INFO(pos, depth) &&
+            (entry[n].check ^ data) == hash )
+        {
+            *value = (int)(unsigned)data;
+            return true;
+        }
+    }
+    return false;
+}
+
+void table_store(Table *table, Hash hash, int pos, int depth, int value)
+{
+    Entry *entry = find_bucket(table, hash, pos), *victim = entry;
+    Hash data = ENTRY_INFO(pos, depth) | (unsigned)value;
+    int n;
+
+    if(depth > TABLE_MAX_DEPTH)
+        return;
+
+    for(n = 0; n < BUCKET_SIZE; ++n)
+    {
+        if((entry[n].check ^ entry[n].data) == hash && entry[n].data == data)
+            return;
+        if(ENTRY_PRIORITY(entry[n].data) < ENTRY_PRIORITY(victim->data))
+            victim = &entry[n];
+    }
+    victim->check = hash ^ data;
+    victim->data  = data;
+}
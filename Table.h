@@ -0,0 +1,18 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "Base.h"
+
+/* Transposition table mapping a field hash, game position and search depth
+   to a search value. The table has a fixed size and may be shared between
+   threads without locking. */
+typedef struct Table Table;
+
+#define TABLE_MAX_DEPTH        15
+
+Table *table_create(size_t size);
+void table_destroy(Table *table);
+bool table_lookup(const Table *table, Hash hash, int pos, int depth, int *value);
+void table_store(Table *table, Hash hash, int pos, int depth, int value);
+
+#endif /* ndef TABLE_H */
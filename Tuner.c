@@ -0,0 +1,398 @@
+#include "Base.h"
+#include "Eval.h"
+#include "Search.h"
+#include <math.h>
+#include <sys/wait.h>
+
+#define TUNE_DEPTH              1   /* default search depth while tuning */
+#define MAX_GAMES            1024
+#define MAX_LAMBDA             64
+#define SCALE                  64   /* weight of the score, which is fixed */
+#define DIMENSIONS      (NUM_WEIGHTS - 1)
+
+/* State of the separable CMA-ES (diagonal covariance) over the weights
+   relative to the score, as kept in the checkpoint file. */
+typedef struct Strategy
+{
+    int         generation;
+    double      sigma;
+    double      mean[DIMENSIONS], var[DIMENSIONS];
+    double      ps[DIMENSIONS], pc[DIMENSIONS];     /* evolution paths */
+    Random      random;
+    long long   best;                               /* total score */
+    int         best_weight[NUM_WEIGHTS];
+} Strategy;
+
+static Game *game[MAX_GAMES];
+static int games, jobs = 1, max_pieces;
+static Policy policy = { TUNE_DEPTH };
+
+/* Returns a standard normally distributed number (Box-Muller). */
+static double random_normal(Random *state)
+{
+    double u = ((next_random(state) >> 11) + 0.5)/9007199254740992.0,
+           v = ((next_random(state) >> 11) + 0.5)/9007199254740992.0;
+    return sqrt(-2*log(u))*cos(6.283185307179586*v);
+}
+
+static void to_weights(const double *x, int *w)
+{
+    int n;
+
+    w[W_SCORE] = SCALE;
+    for(n = 0; n < DIMENSIONS; ++n)
+        w[n + 1] = (int)floor(SCALE*x[n] + 0.5);
+}
+
+/* Plays the corpus with the current weights like the Player does (without
+   transposition table or threads), returning the total final score. */
+static long long play_corpus(void)
+{
+    Searcher searcher = { };
+    long long total = 0;
+    int g, pieces;
+
+    for(g = 0; g < games; ++g)
+    {
+        Field field = { };
+        Stats stats = { };
+        long long start = utime();
+
+        searcher.game = game[g];
+        pieces = game[g]->input_size;
+        if(max_pieces > 0 && pieces > max_pieces)
+            pieces = max_pieces;
+        for(stats.pos = 0; stats.pos < pieces; ++stats.pos)
+        {
+            Move move;
+            int reached;
+
+            if( !choose_move( &searcher, &policy, &field, &stats,
+                              utime() - start, &move, &reached ) ||
+                !apply_move(&field, NULL, game[g], move, &stats) )
+                break;
+        }
+        total += final_score(&stats);
+    }
+    return total;
+}
+
+/* Plays the corpus once per candidate, running up to 'jobs' candidates at
+   a time in child processes that share the loaded games. A candidate that
+   fails gets a score of -1. */
+static void play_candidates( int weights[][NUM_WEIGHTS], long long *score,
+                             int count )
+{
+    pid_t pid[MAX_LAMBDA], p;
+    int fd[MAX_LAMBDA], pipe_fd[2], status, started = 0, running = 0, n;
+
+    while(started < count || running > 0)
+    {
+        if(started < count && running < jobs)
+        {
+            n = started++;
+            score[n] = -1;
+            pid[n] = -1;
+            if(pipe(pipe_fd) != 0)
+                continue;
+            fflush(stdout);
+            pid[n] = fork();
+            if(pid[n] == 0)
+            {
+                long long total;
+                close(pipe_fd[0]);
+                memcpy(weight, weights[n], sizeof(weight));
+                total = play_corpus();
+                _exit(write(pipe_fd[1], &total, sizeof(total)) == sizeof(total) ? 0 : 1);
+            }
+            close(pipe_fd[1]);
+            if(pid[n] < 0)
+                close(pipe_fd[0]);
+            else
+            {
+                fd[n] = pipe_fd[0];
+                ++running;
+            }
+            continue;
+        }
+
+        p = waitpid(-1, &status, 0);
+        n = 0;
+        while(n < started && pid[n] != p)
+            ++n;
+        if(p < 0 || n == started)
+            break;
+        if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+            read(fd[n], &score[n], sizeof(score[n])) != sizeof(score[n]) )
+            score[n] = -1;
+        close(fd[n]);
+        --running;
+    }
+}
+
+static bool save_strategy(const char *path, const Strategy *st)
+{
+    char tmp[1024];
+    FILE *fp;
+    int n;
+
+    if(strlen(path) > sizeof(tmp) - 8)
+        return false;
+    sprintf(tmp, "%s.tmp", path);
+    fp = fopen(tmp, "wt");
+    if(!fp)
+        return false;
+    fprintf(fp, "%d %.17g %llu %lld\n", st->generation, st->sigma,
+            st->random, st->best);
+    for(n = 0; n < NUM_WEIGHTS; ++n)
+        fprintf(fp, "%d ", st->best_weight[n]);
+    fprintf(fp, "\n");
+    for(n = 0; n < DIMENSIONS; ++n)
+        fprintf(fp, "%.17g %.17g %.17g %.17g\n",
+                st->mean[n], st->var[n], st->ps[n], st->pc[n]);
+    if(fclose(fp) != 0)
+        return false;
+    return rename(tmp, path) == 0;
+}
+
+static bool load_strategy(const char *path, Strategy *st)
+{
+    FILE *fp = fopen(path, "rt");
+    bool ok;
+    int n;
+
+    if(!fp)
+        return false;
+    ok = fscanf(fp, "%d %lf %llu %lld", &st->generation, &st->sigma,
+                &st->random, &st->best) == 4;
+    for(n = 0; ok && n < NUM_WEIGHTS; ++n)
+        ok = fscanf(fp, "%d", &st->best_weight[n]) == 1;
+    for(n = 0; ok && n < DIMENSIONS; ++n)
+        ok = fscanf(fp, "%lf %lf %lf %lf", &st->mean[n], &st->var[n],
+                    &st->ps[n], &st->pc[n]) == 4;
+    fclose(fp);
+    return ok;
+}
+
+/* Sorts candidate indices by descending score. */
+static long long *sort_score;
+
+static int compare_candidates(const void *a, const void *b)
+{
+    long long x = sort_score[*(const int*)a], y = sort_score[*(const int*)b];
+    return x < y ? 1 : x > y ? -1 : *(const int*)a - *(const int*)b;
+}
+
+int main(int argc, char *argv[])
+{
+    static char name[MAX_GAMES][MAX_GAME_NAME];
+    static int weights[MAX_LAMBDA][NUM_WEIGHTS];
+    const char *corpus = NULL, *output = "weights.txt",
+               *checkpoint = "tuner.state";
+    char path[1024];
+    double x[MAX_LAMBDA][DIMENSIONS], y[MAX_LAMBDA][DIMENSIONS],
+           rank_weight[MAX_LAMBDA], mueff, cc, cs, c1, cmu, damps, chi,
+           sum, norm, old_mean[DIMENSIONS], yw, z;
+    long long score[MAX_LAMBDA], t;
+    int order[MAX_LAMBDA], lambda = 0, mu, generations = 100, len, n, k, used;
+    Random seed = 1;
+    Strategy st;
+    bool hsig;
+
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    for(n = 1; n < argc; ++n)
+    {
+        if((used = policy_parse(&policy, argc, argv, n)) < 0)
+            return 1;
+        else
+        if(used > 0)
+            n += used - 1;
+        else
+        if(strcmp(argv[n], "-j") == 0 && n + 1 < argc)
+            jobs = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-n") == 0 && n + 1 < argc)
+            max_pieces = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-g") == 0 && n + 1 < argc)
+            generations = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-l") == 0 && n + 1 < argc)
+            lambda = atoi(argv[++n]);
+        else
+        if(strcmp(argv[n], "-s") == 0 && n + 1 < argc)
+            seed = strtoul(argv[++n], NULL, 0);
+        else
+        if(strcmp(argv[n], "-o") == 0 && n + 1 < argc)
+            output = argv[++n];
+        else
+        if(strcmp(argv[n], "-c") == 0 && n + 1 < argc)
+            checkpoint = argv[++n];
+        else
+            corpus = argv[n];
+    }
+    if(!corpus)
+    {
+        fprintf( stderr, "Usage: %s [-j jobs] " POLICY_USAGE " "
+                         "[-n pieces per game] [-g generations] "
+                         "[-l population] [-s seed] [-o weights] "
+                         "[-c checkpoint] <directory of games>\n", argv[0] );
+        return 1;
+    }
+    if(jobs < 1)
+        jobs = 1;
+    policy_normalize(&policy);
+    if(lambda <= 0)
+        lambda = 4 + (int)(3*log(DIMENSIONS));
+    if(lambda < 2 || lambda > MAX_LAMBDA)
+    {
+        fprintf(stderr, "Population size must be between 2 and %d!\n", MAX_LAMBDA);
+        return 1;
+    }
+
+    /* Load the corpus once; the child processes share it */
+    games = find_games(corpus, name, MAX_GAMES);
+    if(games <= 0)
+    {
+        fprintf(stderr, "No games found in \"%s\"!\n", corpus);
+        return 1;
+    }
+    len = sprintf(path, "%s/", corpus);
+    for(n = 0; n < games; ++n)
+    {
+        strcpy(path + len, name[n]);
+        game[n] = load_game(path);
+        if(!game[n])
+        {
+            fprintf(stderr, "Could not load game \"%s\"!\n", path);
+            return 1;
+        }
+    }
+
+    /* Strategy parameters (Hansen's defaults, with the learning rates of
+       the covariance increased for a diagonal matrix as in sep-CMA-ES) */
+    mu = lambda/2;
+    for(sum = 0, k = 0; k < mu; ++k)
+        sum += rank_weight[k] = log(mu + 0.5) - log(k + 1);
+    for(norm = 0, k = 0; k < mu; ++k)
+    {
+        rank_weight[k] /= sum;
+        norm += rank_weight[k]*rank_weight[k];
+    }
+    mueff = 1/norm;
+    cc    = 4.0/(DIMENSIONS + 4);
+    cs    = (mueff + 2)/(DIMENSIONS + mueff + 3);
+    c1    = 2/((DIMENSIONS + 1.3)*(DIMENSIONS + 1.3) + mueff);
+    cmu   = 2*(mueff - 2 + 1/mueff)/((DIMENSIONS + 2)*(DIMENSIONS + 2) + mueff);
+    c1   *= (DIMENSIONS + 2)/3.0;
+    cmu  *= (DIMENSIONS + 2)/3.0;
+    if(cmu > 1 - c1)
+        cmu = 1 - c1;
+    damps = 1 + cs + 2*(sqrt((mueff - 1)/(DIMENSIONS + 1)) > 1 ?
+                        sqrt((mueff - 1)/(DIMENSIONS + 1)) - 1 : 0);
+    chi   = sqrt(DIMENSIONS)*(1 - 1/(4.0*DIMENSIONS) +
+                              1/(21.0*DIMENSIONS*DIMENSIONS));
+
+    /* Start from the default weights, or resume from the checkpoint */
+    if(load_strategy(checkpoint, &st))
+        fprintf( stderr, "Resuming from \"%s\" at generation %d.\n",
+                 checkpoint, st.generation );
+    else
+    {
+        memset(&st, 0, sizeof(st));
+        for(n = 0; n < DIMENSIONS; ++n)
+        {
+            st.mean[n] = (double)weight[n + 1]/weight[W_SCORE];
+            st.var[n]  = 1;
+        }
+        st.sigma  = 0.5;
+        st.random = seed ? seed : 1;
+        st.best   = -1;
+    }
+
+    while(st.generation < generations)
+    {
+        t = utime();
+        for(k = 0; k < lambda; ++k)
+        {
+            for(n = 0; n < DIMENSIONS; ++n)
+            {
+                z = random_normal(&st.random);
+                y[k][n] = sqrt(st.var[n])*z;
+                x[k][n] = st.mean[n] + st.sigma*y[k][n];
+            }
+            to_weights(x[k], weights[k]);
+        }
+        play_candidates(weights, score, lambda);
+        t = utime() - t;
+
+        for(k = 0; k < lambda; ++k)
+            order[k] = k;
+        sort_score = score;
+        qsort(order, lambda, sizeof(*order), compare_candidates);
+
+        if(score[order[0]] > st.best)
+        {
+            st.best = score[order[0]];
+            memcpy(st.best_weight, weights[order[0]], sizeof(st.best_weight));
+            if(!save_weights(output, st.best_weight))
+                fprintf(stderr, "Unable to write weights to \"%s\"!\n", output);
+        }
+
+        /* Move the mean towards the best mu candidates */
+        memcpy(old_mean, st.mean, sizeof(old_mean));
+        for(n = 0; n < DIMENSIONS; ++n)
+        {
+            st.mean[n] = 0;
+            for(k = 0; k < mu; ++k)
+                st.mean[n] += rank_weight[k]*x[order[k]][n];
+        }
+
+        /* Update the evolution paths */
+        for(norm = 0, n = 0; n < DIMENSIONS; ++n)
+        {
+            yw = (st.mean[n] - old_mean[n])/st.sigma;
+            st.ps[n] = (1 - cs)*st.ps[n] +
+                       sqrt(cs*(2 - cs)*mueff)*yw/sqrt(st.var[n]);
+            norm += st.ps[n]*st.ps[n];
+        }
+        norm = sqrt(norm);
+        hsig = norm/sqrt(1 - pow(1 - cs, 2*(st.generation + 1)))/chi <
+               1.4 + 2.0/(DIMENSIONS + 1);
+        for(n = 0; n < DIMENSIONS; ++n)
+        {
+            yw = (st.mean[n] - old_mean[n])/st.sigma;
+            st.pc[n] = (1 - cc)*st.pc[n] +
+                       (hsig ? sqrt(cc*(2 - cc)*mueff)*yw : 0);
+        }
+
+        /* Update the variances and the step size */
+        for(n = 0; n < DIMENSIONS; ++n)
+        {
+            sum = 0;
+            for(k = 0; k < mu; ++k)
+                sum += rank_weight[k]*y[order[k]][n]*y[order[k]][n];
+            st.var[n] = (1 - c1 - cmu)*st.var[n] +
+                        c1*( st.pc[n]*st.pc[n] +
+                             (hsig ? 0 : cc*(2 - cc)*st.var[n]) ) +
+                        cmu*sum;
+        }
+        st.sigma *= exp((cs/damps)*(norm/chi - 1));
+
+        fprintf( stderr, "Generation %4d: best %lld, overall %lld, "
+                 "sigma %.4f, %.1f games/s; weights",
+                 st.generation + 1, score[order[0]], st.best, st.sigma,
+                 t > 0 ? 1e6*lambda*games/t : 0.0 );
+        for(n = 0; n < NUM_WEIGHTS; ++n)
+            fprintf(stderr, " %s %d", weight_name[n], weights[order[0]][n]);
+        fprintf(stderr, "\n");
+
+        ++st.generation;
+        if(!save_strategy(checkpoint, &st))
+            fprintf(stderr, "Unable to write checkpoint \"%s\"!\n", checkpoint);
+    }
+
+    for(n = 0; n < NUM_WEIGHTS; ++n)
+        printf("%s %d\n", weight_name[n], st.best_weight[n]);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Usage: speedup.sh <game directory> [threads]
+#
+# Runs the player on the given game with one thread and with the given number
+# of threads (by default, the number of processors), checks that both runs
+# select the same moves and reports the search speedup.
+
+DIR=${1:?usage: $0 <game directory> [threads]}
+THREADS=${2:-`getconf _NPROCESSORS_ONLN`}
+PLAYER=`dirname "$0"`/player
+TMP=${TMPDIR:-/tmp}/speedup.$$
+
+trap 'rm -f "$TMP".*' EXIT
+
+"$PLAYER" -j 1 "$DIR" >"$TMP.out1" 2>"$TMP.err1" || exit 1
+"$PLAYER" -j "$THREADS" "$DIR" >"$TMP.outN" 2>"$TMP.errN" || exit 1
+
+if ! cmp -s "$TMP.out1" "$TMP.outN"
+then
+    echo "Moves differ between -j 1 and -j $THREADS!" >&2
+    exit 1
+fi
+
+T1=`grep '^Search time' "$TMP.err1" | awk '{ print $NF }'`
+TN=`grep '^Search time' "$TMP.errN" | awk '{ print $NF }'`
+awk -v t1="$T1" -v tn="$TN" -v j="$THREADS" 'BEGIN {
+    printf "Search time with 1 thread (ms):   %8d\n", t1
+    printf "Search time with %d threads (ms): %8d\n", j, tn
+    printf "Speedup:                          %8.2f\n", (tn > 0) ? t1/tn : 0
+}'